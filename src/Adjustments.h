@@ -1,13 +1,23 @@
 #ifndef ADJUSTMNETS_H_
 #define ADJUSTMNETS_H_
+#include <avr/pgmspace.h>
 #include "Globals.h"
 
 #define SEMITONE_ADJ_YM 3 //Adjust this to add or subtract semitones to the final note on the YM2612.
 #define TUNE -0.065     //Use this constant to tune your instrument!
 #define SEMITONE_ADJ_PSG 0 //Adjust this to add or subtract semitones to the final note on the PSG.
 #define MAX_OCTAVE_SHIFT 5
+#define YM_RELEASE_BEND_MS 1000 //How long a released YM2612 channel keeps following the pitch-bender
 
 static short pitchBendYM = 0;
 static unsigned char pitchBendYMRange = 2; //How many semitones would you like the pitch-bender to range? Standard = 2
 
+//Velocity curve for the YM2612 velocity channel. Each entry covers 4 velocity steps (0-3, 4-7 ... 124-127)
+//and is how many TL steps (0.75dB each) to add to the patch's carrier TL. Default is roughly 40*log10(127/velocity) dB
+static const unsigned char velocityCurveYM[32] PROGMEM = 
+{
+  96, 71, 59, 51, 45, 41, 37, 33, 31, 28, 26, 24, 22, 20, 18, 17,
+  15, 14, 13, 11, 10, 9, 8, 7, 6, 5, 4, 3, 3, 2, 1, 0
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "DataBus.h"
+#include <util/atomic.h>
+
+DataBus dataBus;
+
+DataBus::DataBus()
+{
+    memset(acquired, 0, sizeof acquired);
+    memset(heldMax, 0, sizeof heldMax);
+}
+
+bool DataBus::Acquire(BusOwner who)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      if(owner != BUS_FREE)
+        return false;
+      owner = who;
+    }
+    acquired[who]++;
+    heldSince = micros();
+    return true;
+}
+
+void DataBus::Release(BusOwner who)
+{
+    if(owner != who)
+      return;
+    uint16_t held = micros() - heldSince;
+    if(held > heldMax[who])
+      heldMax[who] = held;
+    owner = BUS_FREE;
+}
+
+void DataBus::Defer()
+{
+    deferred++;
+}
+
+void DataBus::DumpStats()
+{
+    static const char* const names[BUS_OWNERS] = {"", "YM2612", "SN76489", "LCD"};
+    for(uint8_t i = BUS_YM2612; i < BUS_OWNERS; i++)
+    {
+      Serial.print(names[i]); Serial.print(" bus holds: "); Serial.print(acquired[i]);
+      Serial.print(" Longest: "); Serial.print(heldMax[i]); Serial.println("uS");
+    }
+    uint16_t d;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      d = deferred;
+      deferred = 0;
+    }
+    Serial.print("YM2612 queue drains deferred: "); Serial.println(d);
+    memset(acquired, 0, sizeof acquired);
+    memset(heldMax, 0, sizeof heldMax);
+}
@@ -0,0 +1,32 @@
+#ifndef DATABUS_H_
+#define DATABUS_H_
+#include <Arduino.h>
+
+//PORTF is the data bus for the YM2612, the SN76489 and the LCD (pins 38-45).
+//Whoever is in the middle of a transfer owns it. The YM2612 queue is drained from the Timer2 ISR, so audio
+//gets the bus whenever nobody is mid-byte: the LCD and the PSG only hold it for one byte at a time and
+//the ISR simply tries again on its next tick if it finds the bus taken.
+//Main-loop users never contend with each other, so Acquire() only fails inside the ISR.
+enum BusOwner
+{
+    BUS_FREE, BUS_YM2612, BUS_SN76489, BUS_LCD, BUS_OWNERS
+};
+
+class DataBus
+{
+private:
+    volatile uint8_t owner = BUS_FREE;
+    volatile uint16_t deferred = 0; //ISR ticks that found the bus taken
+    uint32_t acquired[BUS_OWNERS];
+    uint16_t heldMax[BUS_OWNERS]; //uS
+    uint32_t heldSince = 0;
+public:
+    DataBus();
+    bool Acquire(BusOwner who);
+    void Release(BusOwner who);
+    void Defer();
+    void DumpStats();
+};
+
+extern DataBus dataBus;
+#endif
@@ -4,8 +4,16 @@
 #include "Voice.h"
 
 #define MIDI_MFG_ID 0xFF
+#define MIDI_MFG_ID_7BIT 0x7D //0xFF is a status byte (System Reset). Patch dumps and SysEx over DIN carry the non-commercial ID instead
 #define MIDI_DEVICE_ID 0x05
 
+//SysEx byte 2: command in the high nibble, slot in the low nibble (0 = all channels, 1-6 = one YM2612 channel)
+#define SYSEX_OPM_BLOCK 0x00  //Full OPM voice, 56 bytes
+#define SYSEX_PATCH_DUMP 0x10 //Outgoing patch chunk, device to VST (see PatchDump.h)
+#define SYSEX_PARAM_LIST 0x20 //(NRPN parameter, value) pairs applied as one update
+#define SYSEX_DUMP_REQUEST 0x30 //Low nibble is the dump item instead of a slot
+#define SYSEX_DUMP_ACK 0x40
+
 static const unsigned char leds[] = {1, 3, 4, 5, 6, 7, 24, 27};
 extern bool YMsustainEnabled;
 extern bool PSGsustainEnabled;
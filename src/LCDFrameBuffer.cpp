@@ -0,0 +1,125 @@
+#include "LCDFrameBuffer.h"
+#include "DataBus.h"
+
+LCDFrameBuffer::LCDFrameBuffer(LiquidCrystal &device) : device(device)
+{
+    memset(cells, ' ', sizeof(cells));
+    memset(shown, ' ', sizeof(shown)); //begin() leaves the display blank
+}
+
+void LCDFrameBuffer::clear()
+{
+    memset(cells, ' ', sizeof(cells));
+    col = row = 0;
+    dirty = true;
+}
+
+void LCDFrameBuffer::home()
+{
+    col = row = 0;
+}
+
+void LCDFrameBuffer::setCursor(uint8_t col, uint8_t row)
+{
+    this->col = col;
+    this->row = row;
+}
+
+void LCDFrameBuffer::ClearRow(uint8_t row)
+{
+    if(row >= LCD_ROWS)
+      return;
+    memset(cells[row], ' ', LCD_COLS);
+    dirty = true;
+}
+
+size_t LCDFrameBuffer::write(uint8_t c)
+{
+    if(c == '\r' || c == '\n')
+      return 1; //println() has no meaning on a character display
+    if(row < LCD_ROWS && col < LCD_COLS)
+    {
+      cells[row][col] = c;
+      dirty = true;
+    }
+    col++;
+    return 1;
+}
+
+//Forget what the display holds so the next Flush() repaints every cell
+void LCDFrameBuffer::Invalidate()
+{
+    memset(shown, 0xFF, sizeof(shown));
+    deviceCursor = 0xFF;
+    dirty = true;
+}
+
+bool LCDFrameBuffer::Dirty()
+{
+    return dirty;
+}
+
+//Push up to maxChars changed cells to the display, starting where the last flush stopped.
+//Once one cell is out, shouldYield() is asked before each of the rest. A run of neighbouring cells shares one setCursor()
+uint8_t LCDFrameBuffer::Flush(uint8_t maxChars, LCDYieldCheck shouldYield)
+{
+    if(!dirty)
+      return 0;
+    uint32_t start = micros();
+    uint8_t written = 0;
+    uint8_t *cell = &cells[0][0];
+    uint8_t *was = &shown[0][0];
+    bool complete = true;
+    for(uint8_t n = 0; n < LCD_CELLS; n++)
+    {
+      uint8_t p = scanPos + n;
+      if(p >= LCD_CELLS)
+        p -= LCD_CELLS;
+      if(cell[p] == was[p])
+        continue;
+      if(written == maxChars || (written && shouldYield && shouldYield()))
+      {
+        if(written < maxChars)
+          yields++;
+        scanPos = p;
+        complete = false;
+        break;
+      }
+      //One byte per bus hold so queued YM2612 writes can go out in between
+      if(deviceCursor != p)
+      {
+        dataBus.Acquire(BUS_LCD);
+        device.setCursor(p % LCD_COLS, p / LCD_COLS);
+        dataBus.Release(BUS_LCD);
+      }
+      dataBus.Acquire(BUS_LCD);
+      device.write(cell[p]);
+      dataBus.Release(BUS_LCD);
+      was[p] = cell[p];
+      deviceCursor = (p % LCD_COLS == LCD_COLS-1) ? 0xFF : p+1; //Row ends continue in a different DDRAM line
+      written++;
+    }
+    if(complete)
+    {
+      dirty = false;
+      scanPos = 0;
+    }
+    uint16_t elapsed = micros() - start;
+    if(elapsed > worstFlush)
+      worstFlush = elapsed;
+    flushTime += elapsed;
+    charsWritten += written;
+    flushes++;
+    return written;
+}
+
+void LCDFrameBuffer::DumpStats()
+{
+    Serial.print("LCD flushes: "); Serial.print(flushes);
+    Serial.print(" Cells written: "); Serial.print(charsWritten);
+    Serial.print(" Yielded: "); Serial.println(yields);
+    Serial.print("LCD time per flush avg: "); Serial.print(flushes ? flushTime/flushes : 0);
+    Serial.print("uS Worst: "); Serial.print(worstFlush); Serial.println("uS");
+    flushes = yields = worstFlush = 0;
+    charsWritten = flushTime = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef LCDFRAMEBUFFER_H_
+#define LCDFRAMEBUFFER_H_
+#include <Arduino.h>
+#include <LiquidCrystal.h>
+
+#define LCD_ROWS 4
+#define LCD_COLS 20
+#define LCD_CELLS (LCD_ROWS*LCD_COLS)
+#define LCD_FLUSH_CHARS 4 //Per scheduler pass, each one holds PORTF for ~40uS plus LiquidCrystal's settle delay
+
+typedef bool (*LCDYieldCheck)(); //True when something more urgent is waiting for the bus
+
+//UI code prints into a copy of the display in RAM. Flush() sends only the cells that differ from what the
+//HD44780 is already showing, so a redraw never needs the slow clear() and unchanged text costs nothing on PORTF.
+//Writes past the end of a row are dropped instead of wrapping into the next DDRAM line.
+//A flush can stop part way and carry on from the same cell next time, so the display catches up over a few passes.
+class LCDFrameBuffer : public Print
+{
+private:
+    LiquidCrystal &device;
+    uint8_t cells[LCD_ROWS][LCD_COLS];
+    uint8_t shown[LCD_ROWS][LCD_COLS];
+    uint8_t col = 0;
+    uint8_t row = 0;
+    bool dirty = false;
+    uint8_t scanPos = 0; //Cell the next flush starts from
+    uint8_t deviceCursor = 0xFF; //Cell the HD44780 writes next, 0xFF if unknown
+    uint32_t charsWritten = 0;
+    uint16_t flushes = 0;
+    uint16_t yields = 0;
+    uint32_t flushTime = 0;
+    uint16_t worstFlush = 0;
+public:
+    LCDFrameBuffer(LiquidCrystal &device);
+    void clear();
+    void home();
+    void setCursor(uint8_t col, uint8_t row);
+    void ClearRow(uint8_t row);
+    virtual size_t write(uint8_t c);
+    using Print::write;
+    void Invalidate();
+    uint8_t Flush(uint8_t maxChars = LCD_CELLS, LCDYieldCheck shouldYield = NULL);
+    bool Dirty();
+    void DumpStats();
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "MidiEvents.h"
+
+MidiEventQueue midiEvents;
+
+//Returns false when full, the caller should apply what is queued and try again
+bool MidiEventQueue::Push(const MidiEvent &e)
+{
+    uint8_t next = (orderedHead + 1) & (MIDI_ORDERED_SIZE-1);
+    if(next == orderedTail)
+    {
+      orderedFull++;
+      return false;
+    }
+    ordered[orderedHead] = e;
+    ordered[orderedHead].sequence = sequence++;
+    orderedHead = next;
+    queued++;
+    uint8_t depth = (orderedHead - orderedTail) & (MIDI_ORDERED_SIZE-1);
+    if(depth > orderedMax)
+      orderedMax = depth;
+    return true;
+}
+
+//Returns false when every slot holds a different target, the caller should apply what is queued and try again
+bool MidiEventQueue::Coalesce(const MidiEvent &e)
+{
+    for(uint8_t i = latestRead; i<latestCount; i++)
+    {
+      if(latest[i].type == e.type && latest[i].channel == e.channel && latest[i].param == e.param)
+      {
+        latest[i].value = e.value; //The slot keeps its first sequence, the newer value only goes out sooner
+        latest[i].arrival = e.arrival;
+        queued++;
+        coalesced++;
+        return true;
+      }
+    }
+    if(latestCount == MIDI_COALESCE_SLOTS)
+    {
+      if(latestRead == 0)
+      {
+        latestFull++;
+        return false;
+      }
+      //Slots before latestRead were already applied, move the waiting ones down over them
+      latestCount -= latestRead;
+      memmove(latest, &latest[latestRead], latestCount * sizeof(MidiEvent));
+      latestRead = 0;
+    }
+    latest[latestCount] = e;
+    latest[latestCount++].sequence = sequence++;
+    queued++;
+    if(latestCount - latestRead > latestMax)
+      latestMax = latestCount - latestRead;
+    return true;
+}
+
+//Whichever of the oldest ordered event and the oldest coalesce slot arrived first
+bool MidiEventQueue::Pop(MidiEvent &e)
+{
+    bool latestWaiting = latestRead < latestCount;
+    if(orderedTail != orderedHead &&
+      (!latestWaiting || (int16_t)(ordered[orderedTail].sequence - latest[latestRead].sequence) < 0))
+    {
+      e = ordered[orderedTail];
+      orderedTail = (orderedTail + 1) & (MIDI_ORDERED_SIZE-1);
+      return true;
+    }
+    if(latestWaiting)
+    {
+      e = latest[latestRead++];
+      if(latestRead == latestCount)
+        latestRead = latestCount = 0;
+      return true;
+    }
+    return false;
+}
+
+void MidiEventQueue::DumpStats()
+{
+    Serial.print("MIDI events queued: "); Serial.print(queued);
+    Serial.print(" Coalesced: "); Serial.println(coalesced);
+    Serial.print("Ordered max depth: "); Serial.print(orderedMax); Serial.print("/"); Serial.print(MIDI_ORDERED_SIZE-1);
+    Serial.print(" Full: "); Serial.println(orderedFull);
+    Serial.print("Coalesce max slots: "); Serial.print(latestMax); Serial.print("/"); Serial.print(MIDI_COALESCE_SLOTS);
+    Serial.print(" Full: "); Serial.println(latestFull);
+    queued = coalesced = 0;
+    orderedFull = latestFull = 0;
+    orderedMax = latestMax = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef MIDIEVENTS_H_
+#define MIDIEVENTS_H_
+#include <Arduino.h>
+
+//USB and DIN MIDI handlers only queue events, loop() applies them.
+//Notes, program changes and sustain keep their order. Controllers, pitch bend and NRPN only need their
+//latest value, so a new one replaces whatever is still waiting for the same target and keeps its place.
+//Both kinds come out in arrival order, so an MPE bend sent just before its note-on is applied first.
+const uint8_t MIDI_ORDERED_SIZE = 32; //Must be a power of 2
+const uint8_t MIDI_COALESCE_SLOTS = 16;
+
+enum MidiEventType
+{
+    MIDI_EVENT_NOTE_ON, MIDI_EVENT_NOTE_OFF, MIDI_EVENT_PROGRAM, MIDI_EVENT_SUSTAIN,
+    MIDI_EVENT_CONTROL, MIDI_EVENT_PITCH, MIDI_EVENT_NRPN
+};
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t channel;
+    uint16_t param; //Key, controller or NRPN parameter
+    int16_t value; //Velocity, controller value, bend or NRPN value
+    uint32_t arrival; //micros() when the handler queued it, for NoteLatency
+    uint16_t sequence; //Set by the queue, arrival order across both kinds of event
+} MidiEvent;
+
+class MidiEventQueue
+{
+private:
+    MidiEvent ordered[MIDI_ORDERED_SIZE];
+    uint8_t orderedHead = 0;
+    uint8_t orderedTail = 0;
+    MidiEvent latest[MIDI_COALESCE_SLOTS];
+    uint8_t latestCount = 0;
+    uint8_t latestRead = 0;
+    uint16_t sequence = 0;
+    uint32_t queued = 0;
+    uint32_t coalesced = 0;
+    uint16_t orderedFull = 0;
+    uint16_t latestFull = 0;
+    uint8_t orderedMax = 0;
+    uint8_t latestMax = 0;
+public:
+    bool Push(const MidiEvent &e);
+    bool Coalesce(const MidiEvent &e);
+    bool Pop(MidiEvent &e);
+    void DumpStats();
+};
+
+extern MidiEventQueue midiEvents;
+#endif
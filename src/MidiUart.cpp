@@ -0,0 +1,103 @@
+#include "MidiUart.h"
+#include <util/atomic.h>
+
+MidiUart midiUart;
+
+void MidiUart::begin(long baud)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      head = tail = 0;
+    }
+    UCSR1B = 0;
+    UCSR1A = 0;
+    UBRR1 = F_CPU/16/baud - 1; //31250 baud = 31 at 16MHz, exact
+    UCSR1C = bit(UCSZ11) | bit(UCSZ10); //8N1
+    UCSR1B = bit(RXEN1) | bit(RXCIE1); //Receive only. The TX pin drives an LED (see leds[])
+}
+
+int MidiUart::available()
+{
+    uint16_t h;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      h = head;
+    }
+    uint16_t count = (h - tail) & (MIDI_UART_BUFFER_SIZE-1);
+    if(count > highWater)
+      highWater = count;
+    return count;
+}
+
+int MidiUart::read()
+{
+    uint16_t h;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      h = head;
+    }
+    if(h == tail)
+      return -1;
+    uint8_t data = buffer[tail];
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      tail = (tail + 1) & (MIDI_UART_BUFFER_SIZE-1);
+    }
+    return data;
+}
+
+size_t MidiUart::write(uint8_t data)
+{
+    return 0; //MIDI thru is off and the transmitter is not enabled
+}
+
+void MidiUart::Receive()
+{
+    uint8_t status = UCSR1A;
+    uint8_t data = UDR1;
+    if(status & bit(DOR1))
+      overruns++;
+    if(status & bit(FE1))
+    {
+      framingErrors++;
+      return;
+    }
+    uint16_t next = (head + 1) & (MIDI_UART_BUFFER_SIZE-1);
+    if(next == tail)
+    {
+      overflows++;
+      return;
+    }
+    buffer[head] = data;
+    head = next;
+}
+
+uint16_t MidiUart::GetOverflows()
+{
+    uint16_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      count = overflows;
+    }
+    return count;
+}
+
+void MidiUart::DumpStats()
+{
+    uint16_t dropped, lost, framing;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      dropped = overflows;
+      lost = overruns;
+      framing = framingErrors;
+    }
+    Serial.print("DIN buffer overflows: "); Serial.println(dropped);
+    Serial.print("DIN USART overruns: "); Serial.println(lost);
+    Serial.print("DIN framing errors: "); Serial.println(framing);
+    Serial.print("DIN buffer high water: "); Serial.print(highWater); Serial.print("/"); Serial.println(MIDI_UART_BUFFER_SIZE-1);
+}
+
+ISR(USART1_RX_vect)
+{
+    midiUart.Receive();
+}
@@ -0,0 +1,31 @@
+#ifndef MIDIUART_H_
+#define MIDIUART_H_
+#include <Arduino.h>
+
+//DIN MIDI input on USART1. Stands in for Serial1 as the MIDI library's serial port.
+//The RX interrupt moves every byte into a ring buffer, so nothing is lost while loop() is busy
+//with LCD redraws, file loads or serial dumps. 512 bytes = ~160mS of solid 31250 baud traffic.
+const uint16_t MIDI_UART_BUFFER_SIZE = 512; //Must be a power of 2
+
+class MidiUart
+{
+private:
+    volatile uint8_t buffer[MIDI_UART_BUFFER_SIZE];
+    volatile uint16_t head = 0; //Written by the ISR
+    volatile uint16_t tail = 0; //Written by read()
+    volatile uint16_t overflows = 0; //Bytes dropped because the ring was full
+    volatile uint16_t overruns = 0; //USART reported a lost byte (DOR1)
+    volatile uint16_t framingErrors = 0;
+    uint16_t highWater = 0;
+public:
+    void begin(long baud);
+    int available();
+    int read();
+    size_t write(uint8_t data);
+    void Receive(); //Called from the RX interrupt
+    uint16_t GetOverflows();
+    void DumpStats();
+};
+
+extern MidiUart midiUart;
+#endif
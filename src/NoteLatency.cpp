@@ -0,0 +1,124 @@
+#include "NoteLatency.h"
+
+NoteLatency noteLatency;
+
+LatencyHistogram::LatencyHistogram()
+{
+    Clear();
+}
+
+void LatencyHistogram::Clear()
+{
+    memset(bins, 0, sizeof bins);
+    count = 0;
+    total = 0;
+    minimum = 0xFFFFFFFF;
+    maximum = 0;
+}
+
+void LatencyHistogram::Add(uint32_t us)
+{
+    uint8_t bin = 0;
+    for(uint32_t v = us >> 1; v != 0 && bin < LATENCY_BINS-1; v >>= 1)
+      bin++;
+    if(bins[bin] != 0xFFFF)
+      bins[bin]++;
+    count++;
+    total += us;
+    if(us < minimum)
+      minimum = us;
+    if(us > maximum)
+      maximum = us;
+}
+
+//Upper edge of the bin holding the requested percentile
+uint32_t LatencyHistogram::Percentile(uint8_t percent)
+{
+    uint32_t target = (count * percent + 99) / 100;
+    uint32_t seen = 0;
+    for(uint8_t i = 0; i<LATENCY_BINS; i++)
+    {
+      seen += bins[i];
+      if(seen >= target)
+        return i == LATENCY_BINS-1 ? maximum : (2UL << i) - 1;
+    }
+    return maximum;
+}
+
+void LatencyHistogram::Print(const char* name)
+{
+    Serial.print(name);
+    if(count == 0)
+    {
+      Serial.println(" no samples");
+      return;
+    }
+    Serial.print(" n:"); Serial.print(count);
+    Serial.print(" min:"); Serial.print(minimum);
+    Serial.print(" avg:"); Serial.print(total/count);
+    Serial.print(" max:"); Serial.print(maximum);
+    Serial.print(" p50<="); Serial.print(Percentile(50));
+    Serial.print(" p90<="); Serial.print(Percentile(90));
+    Serial.print(" p99<="); Serial.print(Percentile(99));
+    Serial.println("uS");
+}
+
+void NoteLatency::Dispatched(uint32_t arrival)
+{
+    current.arrival = arrival;
+    current.dispatch = micros();
+}
+
+//Only key-ons that got a stamp pop one when written, so a full ring never shifts later matches
+bool NoteLatency::KeyOnQueued()
+{
+    uint8_t next = (pendingHead + 1) & (LATENCY_PENDING-1);
+    if(next == pendingTail)
+    {
+      dropped++;
+      return false;
+    }
+    pending[pendingHead] = current;
+    pendingHead = next;
+    return true;
+}
+
+void NoteLatency::KeyOnWritten()
+{
+    if(pendingTail == pendingHead)
+      return; //Discarded by Reset()
+    uint32_t now = micros();
+    Stamp s = pending[pendingTail];
+    pendingTail = (pendingTail + 1) & (LATENCY_PENDING-1);
+    toDispatch.Add(s.dispatch - s.arrival);
+    toWrite.Add(now - s.dispatch);
+    toChip.Add(now - s.arrival);
+}
+
+void NoteLatency::Discard()
+{
+    uint8_t sreg = SREG;
+    cli();
+    pendingTail = pendingHead;
+    SREG = sreg;
+}
+
+void NoteLatency::DumpAndReset()
+{
+    uint8_t sreg = SREG;
+    cli();
+    LatencyHistogram dispatch = toDispatch;
+    LatencyHistogram write = toWrite;
+    LatencyHistogram chip = toChip;
+    toDispatch.Clear();
+    toWrite.Clear();
+    toChip.Clear();
+    uint16_t lost = dropped;
+    dropped = 0;
+    SREG = sreg;
+
+    dispatch.Print("Arrival->handler:");
+    write.Print("Handler->key on:");
+    chip.Print("Arrival->key on:");
+    Serial.print("Untracked key ons: "); Serial.println(lost);
+}
@@ -0,0 +1,54 @@
+#ifndef NOTELATENCY_H_
+#define NOTELATENCY_H_
+#include <Arduino.h>
+
+//Note-on latency from MIDI arrival to the YM2612 0x28 key-on write.
+//The AVR has no free-running cycle counter (Timer1/Timer3 are the chip clocks, Timer2 drains the
+//write queue) so stamps come from micros(), which has a 4uS resolution on the Teensy++2.0.
+//Arrival is stamped by the MIDI handler when the event is queued, so time spent waiting in the
+//event queue behind patch loads, LCD redraws or SD access shows up in arrival->handler.
+const uint8_t LATENCY_BINS = 16; //Bin n holds [2^n, 2^(n+1)) uS, bin 0 also holds 0. Last bin holds everything above
+const uint8_t LATENCY_PENDING = 16; //Must be a power of 2
+
+class LatencyHistogram
+{
+private:
+    uint16_t bins[LATENCY_BINS];
+    uint32_t count;
+    uint32_t total;
+    uint32_t minimum;
+    uint32_t maximum;
+    uint32_t Percentile(uint8_t percent);
+public:
+    LatencyHistogram();
+    void Add(uint32_t us);
+    void Print(const char* name);
+    void Clear();
+};
+
+class NoteLatency
+{
+private:
+    typedef struct
+    {
+        uint32_t arrival;
+        uint32_t dispatch;
+    } Stamp;
+    Stamp current;
+    Stamp pending[LATENCY_PENDING]; //Key-ons sitting in the YM2612 write queue
+    volatile uint8_t pendingHead = 0;
+    volatile uint8_t pendingTail = 0;
+    uint16_t dropped = 0;
+    LatencyHistogram toDispatch;
+    LatencyHistogram toWrite;
+    LatencyHistogram toChip;
+public:
+    void Dispatched(uint32_t arrival);
+    bool KeyOnQueued(); //False if the stamp was dropped, the key-on is then written untracked
+    void KeyOnWritten(); //Called from the write queue for stamped key-ons only, interrupts disabled
+    void Discard();
+    void DumpAndReset();
+};
+
+extern NoteLatency noteLatency;
+#endif
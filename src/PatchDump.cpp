@@ -0,0 +1,135 @@
+#include "PatchDump.h"
+
+PatchDump patchDump;
+
+void PatchDump::SetSource(DumpSource source)
+{
+    this->source = source;
+}
+
+void PatchDump::Request(uint8_t item)
+{
+    if(item == DUMP_ALL_ITEMS)
+      requested = (1 << DUMP_ITEMS) - 1;
+    else if(item < DUMP_ITEMS)
+      requested |= 1 << item;
+}
+
+void PatchDump::Ack(uint8_t item, uint8_t chunk)
+{
+    if(!awaitingAck || item != this->item || chunk != this->chunk)
+      return; //Late ack for a chunk that was already resent
+    awaitingAck = false;
+    retries = 0;
+    if(++this->chunk == DUMP_CHUNKS)
+    {
+      this->item = 0xFF;
+      itemsSent++;
+    }
+}
+
+//Called from the scheduler. Sends at most one chunk per call
+void PatchDump::Update()
+{
+    if(awaitingAck)
+    {
+      if(millis() - sentAt < DUMP_ACK_TIMEOUT_MS)
+        return;
+      if(retries == DUMP_RETRIES)
+      {
+        awaitingAck = false; //Editor went away, give up on this item
+        item = 0xFF;
+        dropped++;
+        return;
+      }
+      retries++;
+      resends++;
+      SendChunk();
+      return;
+    }
+    if(item == 0xFF)
+    {
+      if(!requested || source == NULL)
+        return;
+      uint8_t next = 0;
+      while(!(requested & (1 << next)))
+        next++;
+      requested &= ~(1 << next);
+      if(!source(next, voice))
+        return; //Empty favorite, nothing to send
+      item = next;
+      chunk = 0;
+      retries = 0;
+    }
+    SendChunk();
+}
+
+uint8_t PatchDump::Pack(const uint8_t *in, uint8_t length, uint8_t *out)
+{
+    uint8_t j = 0;
+    for(uint8_t i = 0; i < length; i += 7)
+    {
+      uint8_t group = min<uint8_t>(7, length - i);
+      uint8_t &highBits = out[j++];
+      highBits = 0;
+      for(uint8_t k = 0; k < group; k++)
+      {
+        highBits |= (in[i+k] >> 7) << k;
+        out[j++] = in[i+k] & 0x7F;
+      }
+    }
+    return j;
+}
+
+//Inverse of Pack(), what the editor does with a chunk. Returns the number of raw bytes
+uint8_t PatchDump::Unpack(const uint8_t *in, uint8_t length, uint8_t *out)
+{
+    uint8_t j = 0;
+    for(uint8_t i = 0; i < length; i += 8)
+    {
+      uint8_t highBits = in[i];
+      uint8_t group = min<uint8_t>(7, length - i - 1);
+      for(uint8_t k = 0; k < group; k++)
+        out[j++] = in[i+1+k] | (((highBits >> k) & 1) << 7);
+    }
+    return j;
+}
+
+uint8_t PatchDump::Checksum(const uint8_t *packed, uint8_t length)
+{
+    uint8_t sum = 0;
+    for(uint8_t i = 0; i < length; i++)
+      sum += packed[i];
+    return -sum & 0x7F;
+}
+
+void PatchDump::SendChunk()
+{
+    uint8_t data[5 + DUMP_CHUNK_SIZE + (DUMP_CHUNK_SIZE+6)/7 + 2];
+    uint8_t offset = chunk * DUMP_CHUNK_SIZE;
+    uint8_t length = min<uint8_t>(DUMP_CHUNK_SIZE, sizeof(Voice) - offset);
+    data[0] = 0xF0;
+    data[1] = MIDI_MFG_ID_7BIT;
+    data[2] = SYSEX_PATCH_DUMP | item;
+    data[3] = chunk;
+    data[4] = DUMP_CHUNKS;
+    uint8_t j = 5 + Pack((const uint8_t *)&voice + offset, length, &data[5]);
+    data[j] = Checksum(&data[5], j-5);
+    j++;
+    data[j++] = 0xF7;
+    usbMIDI.sendSysEx(j, data, true);
+    awaitingAck = true;
+    sentAt = millis();
+    chunksSent++;
+}
+
+void PatchDump::DumpStats()
+{
+    Serial.print("Patch dump items: "); Serial.print(itemsSent);
+    Serial.print(" Chunks: "); Serial.print(chunksSent);
+    Serial.print(" Resent: "); Serial.print(resends);
+    Serial.print(" Dropped: "); Serial.println(dropped);
+    Serial.print("Sending item: "); Serial.print(item == 0xFF ? -1 : item);
+    Serial.print(" Requested: 0x"); Serial.println(requested, HEX);
+    itemsSent = chunksSent = resends = dropped = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef PATCHDUMP_H_
+#define PATCHDUMP_H_
+#include <Arduino.h>
+#include "Globals.h"
+
+//Patch dumps to the VST editor. A voice goes out as small SysEx chunks, one per scheduler pass, and the
+//next chunk waits for the editor to acknowledge the last so a dump never holds up note handling.
+//  Request: F0 MFG 3n F7                                  n = item, 0x0F = every item
+//  Chunk:   F0 7D 1n <chunk> <chunks> <packed> <sum> F7
+//  Ack:     F0 MFG 4n <chunk> F7
+//Chunks always carry MIDI_MFG_ID_7BIT so every byte between F0 and F7 is a data byte. Requests and acks
+//are taken with either ID
+//Item 0 is the voice loaded on the chip (channel 0), items 1-7 are favorites 1-7, the same numbers as the
+//favorite buttons and NRPN 71-77. The payload is the 56 byte OPM Voice.
+//Every 7 bytes are packed as one byte of high bits (bit 0 = first byte) followed by the 7 low bits of each.
+//The checksum makes the packed bytes plus sum add up to 0 in 7 bits. Unacknowledged chunks are sent again.
+const uint8_t DUMP_ITEM_CURRENT = 0;
+const uint8_t DUMP_ITEMS = 8;
+const uint8_t DUMP_ALL_ITEMS = 0x0F;
+const uint8_t DUMP_CHUNK_SIZE = 28; //Raw bytes, packs to 32
+const uint8_t DUMP_CHUNKS = (sizeof(Voice) + DUMP_CHUNK_SIZE-1) / DUMP_CHUNK_SIZE;
+const uint16_t DUMP_ACK_TIMEOUT_MS = 250;
+const uint8_t DUMP_RETRIES = 3;
+
+typedef bool (*DumpSource)(uint8_t item, Voice &v); //False if there is nothing stored for the item
+
+class PatchDump
+{
+private:
+    DumpSource source = NULL;
+    uint16_t requested = 0; //One bit per item
+    uint8_t item = 0xFF; //Item being sent
+    Voice voice;
+    uint8_t chunk = 0;
+    bool awaitingAck = false;
+    uint32_t sentAt = 0;
+    uint8_t retries = 0;
+    uint16_t itemsSent = 0;
+    uint16_t chunksSent = 0;
+    uint16_t resends = 0;
+    uint16_t dropped = 0;
+    void SendChunk();
+public:
+    void SetSource(DumpSource source);
+    void Request(uint8_t item);
+    void Ack(uint8_t item, uint8_t chunk);
+    void Update();
+    static uint8_t Pack(const uint8_t *in, uint8_t length, uint8_t *out);
+    static uint8_t Unpack(const uint8_t *in, uint8_t length, uint8_t *out);
+    static uint8_t Checksum(const uint8_t *packed, uint8_t length);
+    void DumpStats();
+};
+
+extern PatchDump patchDump;
+#endif
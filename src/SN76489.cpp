@@ -1,4 +1,5 @@
 #include "SN76489.h"
+#include "DataBus.h"
 
 //Referenced from https://github.com/cdodd/teensy-sn76489-midi-synth/blob/master/teensy-sn76489-midi-synth.ino
 
@@ -28,11 +29,14 @@ void SN76489::send(uint8_t data)
     //  0           DATA
     //|0|0| |F0|F1|F2|F3|F4|F5|
 
+    //Keep the YM2612 write queue ISR off the shared bus during the strobe. Interrupts stay on
+    dataBus.Acquire(BUS_SN76489);
     digitalWriteFast(_WE, HIGH);
     PORTF = data;
     digitalWriteFast(_WE, LOW);
     delayMicroseconds(25);
     digitalWriteFast(_WE, HIGH);
+    dataBus.Release(BUS_SN76489);
 }
 
 
@@ -156,20 +160,63 @@ void SN76489::PitchChange(uint8_t channel, int pitch)
     if (channel < 0 || channel > 2)
         return;
     currentPitchBend[channel] = pitch;
-    UpdateSquarePitch(channel);
+    bendPending |= 1 << channel;
+}
+
+//Only the latest bend matters, apply it once per loop to the voices that are sounding
+void SN76489::UpdatePitchBend()
+{
+    if(!bendPending)
+        return;
+    for(uint8_t i = 0; i<MAX_CHANNELS_PSG; i++)
+    {
+        if((bendPending & (1 << i)) && channels[i].keyOn)
+            UpdateSquarePitch(i);
+    }
+    bendPending = 0;
+}
+
+//Tone period for every MIDI note at a 4MHz clock: clockHz / (32 * 440 * 2^((note-69)/12)), truncated.
+//Kept unfolded so neighbours can be interpolated. Anything over 1023 is folded up into range when it is used
+static const uint16_t notePeriod[128] PROGMEM = 
+{
+  15289, 14430, 13620, 12856, 12134, 11453, 10810, 10204, 9631, 9090, 8580, 8099,
+  7644, 7215, 6810, 6428, 6067, 5726, 5405, 5102, 4815, 4545, 4290, 4049,
+  3822, 3607, 3405, 3214, 3033, 2863, 2702, 2551, 2407, 2272, 2145, 2024,
+  1911, 1803, 1702, 1607, 1516, 1431, 1351, 1275, 1203, 1136, 1072, 1012,
+  955, 901, 851, 803, 758, 715, 675, 637, 601, 568, 536, 506,
+  477, 450, 425, 401, 379, 357, 337, 318, 300, 284, 268, 253,
+  238, 225, 212, 200, 189, 178, 168, 159, 150, 142, 134, 126,
+  119, 112, 106, 100, 94, 89, 84, 79, 75, 71, 67, 63,
+  59, 56, 53, 50, 47, 44, 42, 39, 37, 35, 33, 31,
+  29, 28, 26, 25, 23, 22, 21, 19, 18, 17, 16, 15,
+  14, 14, 13, 12, 11, 11, 10, 9
+};
+
+//Period for a note plus a bend in 1/4096ths of a semitone (+-8192 = +-2 semitones)
+uint16_t SN76489::NoteToPeriod(uint8_t note, int bend)
+{
+    int32_t position = ((int32_t)note << 12) + bend;
+    if(position < 0)
+      position = 0;
+    else if(position > (127L << 12))
+      position = 127L << 12;
+    uint8_t n = position >> 12;
+    uint16_t fraction = position & 0x0FFF;
+    uint16_t period = pgm_read_word(&notePeriod[n]);
+    if(fraction)
+      period -= ((uint32_t)(period - pgm_read_word(&notePeriod[n+1])) * fraction) >> 12;
+    //The lowest notes are below what 10 bits can reach, play them an octave (or more) up instead
+    while(period > 1023)
+      period >>= 1;
+    return period;
 }
 
 bool SN76489::UpdateSquarePitch(uint8_t voice)
 {
-    float pitchInHz;
-    unsigned int frequencyData;
     if (voice < 0 || voice > 2)
         return false;
-    pitchInHz = 440 * pow(2, (float(currentNote[voice] - 69) / 12) + (float(currentPitchBend[voice] - 8192) / ((unsigned int)4096 * 12)));
-    frequencyData = clockHz / float(32 * pitchInHz);
-    if (frequencyData > 1023)
-        return false;
-    SetSquareFrequency(voice, frequencyData);
+    SetSquareFrequency(voice, NoteToPeriod(currentNote[voice], currentPitchBend[voice] - 8192));
     return true;
 }
 
@@ -199,7 +246,6 @@ void SN76489::SetChannelOff(uint8_t key)
         {
             if(channels[i].sustained)
               continue;
-            channels[i].keyOn = false;
             channel = i;
             break;
         }
@@ -208,18 +254,25 @@ void SN76489::SetChannelOff(uint8_t key)
         return;
     if (key != currentNote[channel])
         return;
+    ReleaseChannel(channel);
+}
+
+void SN76489::ReleaseChannel(uint8_t channel)
+{
+    channels[channel].keyOn = false;
     currentVelocity[channel] = 0;
     UpdateAttenuation(channel);
 }
 
+//Pedal up. Works on the channels directly instead of searching for each key again
 void SN76489::ReleaseSustainedKeys()
 {
-    for(int i = 0; i<MAX_CHANNELS_PSG; i++)
+    for(uint8_t i = 0; i<MAX_CHANNELS_PSG; i++)
     {
         if(channels[i].sustained && channels[i].keyOn)
         {
             channels[i].sustained = false;
-            SetChannelOff(channels[i].keyNumber);
+            ReleaseChannel(i);
         }
     }
 }
@@ -17,12 +17,14 @@ private:
         bool sustained = false;
         uint8_t keyNumber = 0;
     } Channel;
-    const long clockHz = 4000000;
+    const long clockHz = 4000000; //notePeriod[] in SN76489.cpp is built for this clock
     const uint8_t attenuationRegister[4] = {0x10, 0x30, 0x50, 0x70};
     const uint8_t frequencyRegister[3] = {0x00, 0x20, 0x40};
     uint8_t currentNote[4] = {0, 0, 0, 0};
     uint8_t currentVelocity[4] = {0, 0, 0, 0};
     int currentPitchBend[3] = {8192, 8192, 8192};
+    uint8_t bendPending = 0; //Bit per voice
+    void ReleaseChannel(uint8_t channel);
 public:
     SN76489();
     Channel channels[MAX_CHANNELS_PSG];
@@ -37,8 +39,10 @@ public:
     void ReleaseSustainedKeys();
     void UpdateAttenuation(uint8_t voice);
     void SetSquareFrequency(uint8_t voice, int frequencyData);
+    uint16_t NoteToPeriod(uint8_t note, int bend);
     bool UpdateSquarePitch(uint8_t voice);
     void PitchChange(uint8_t channel, int pitch);
+    void UpdatePitchBend();
     void Reset();
     void send(uint8_t data);
 };
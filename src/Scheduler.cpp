@@ -0,0 +1,102 @@
+#include "Scheduler.h"
+
+Scheduler scheduler;
+
+bool Scheduler::Add(const char* name, TaskFunction run, TaskPriority priority, uint16_t budget)
+{
+    if(taskCount == SCHEDULER_MAX_TASKS)
+      return false;
+    //Keep the table sorted by priority, same priority runs in the order it was added
+    uint8_t pos = taskCount;
+    while(pos > 0 && tasks[pos-1].priority > priority)
+    {
+      tasks[pos] = tasks[pos-1];
+      pos--;
+    }
+    Task &t = tasks[pos];
+    memset(&t, 0, sizeof t);
+    t.name = name;
+    t.run = run;
+    t.priority = priority;
+    t.budget = budget;
+    taskCount++;
+    if(priority == TASK_CRITICAL)
+      criticalCount++;
+    return true;
+}
+
+void Scheduler::RunTask(Task &t)
+{
+    sliceBudget = t.budget;
+    sliceStart = micros();
+    t.run();
+    uint32_t elapsed = micros() - sliceStart;
+    t.runs++;
+    t.totalMicros += elapsed;
+    if(elapsed > t.maxMicros)
+      t.maxMicros = elapsed;
+    if(elapsed > t.budget)
+      t.overruns++;
+    t.waiting = false;
+}
+
+void Scheduler::RunCritical()
+{
+    for(uint8_t i = 0; i<criticalCount; i++)
+      RunTask(tasks[i]);
+}
+
+void Scheduler::Run()
+{
+    passes++;
+    uint32_t passStart = micros();
+    RunCritical();
+    uint16_t ran = 0; //One bit per task, SCHEDULER_MAX_TASKS <= 16
+    for(uint8_t i = criticalCount; i<taskCount; i++)
+    {
+      if(!tasks[i].waiting)
+        continue;
+      RunTask(tasks[i]);
+      RunCritical();
+      ran |= 1 << i;
+    }
+    for(uint8_t i = criticalCount; i<taskCount; i++)
+    {
+      Task &t = tasks[i];
+      if(ran & (1 << i))
+        continue;
+      if(micros() - passStart >= SCHEDULER_PASS_BUDGET)
+      {
+        t.waiting = true;
+        t.deferred++;
+        continue;
+      }
+      RunTask(t);
+      RunCritical();
+    }
+}
+
+//For tasks that can stop part way: true once the running task has used up its budget
+bool Scheduler::SliceExpired()
+{
+    return micros() - sliceStart >= sliceBudget;
+}
+
+void Scheduler::DumpStats()
+{
+    Serial.print("Scheduler passes: "); Serial.println(passes);
+    for(uint8_t i = 0; i<taskCount; i++)
+    {
+      Task &t = tasks[i];
+      Serial.print(t.name);
+      Serial.print(" P"); Serial.print(t.priority);
+      Serial.print(" runs:"); Serial.print(t.runs);
+      Serial.print(" avg:"); Serial.print(t.runs ? t.totalMicros/t.runs : 0);
+      Serial.print(" max:"); Serial.print(t.maxMicros);
+      Serial.print("/"); Serial.print(t.budget);
+      Serial.print("uS overruns:"); Serial.print(t.overruns);
+      Serial.print(" deferred:"); Serial.println(t.deferred);
+      t.runs = t.totalMicros = t.maxMicros = t.overruns = t.deferred = 0;
+    }
+    passes = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+#include <Arduino.h>
+
+//Cooperative scheduler for loop(). Critical tasks (MIDI in, applying MIDI events) run at the start of every
+//pass and again after each background task, so nothing waits behind more than one background task.
+//Background tasks that missed out last pass run first, whatever the budget, then the rest run in priority order
+//until the pass budget is spent.
+//Tasks run to completion. Only the LCD flush checks SliceExpired() and picks up where it left off; file loads,
+//SD access and serial commands still run in one go and show up as overruns in DumpStats().
+const uint8_t SCHEDULER_MAX_TASKS = 12;
+const uint16_t SCHEDULER_PASS_BUDGET = 2000; //uS of background work per pass
+
+enum TaskPriority
+{
+    TASK_CRITICAL, TASK_HIGH, TASK_NORMAL, TASK_LOW
+};
+
+typedef void (*TaskFunction)();
+
+class Scheduler
+{
+private:
+    typedef struct
+    {
+        const char* name;
+        TaskFunction run;
+        uint8_t priority;
+        uint16_t budget; //uS
+        bool waiting; //Missed out last pass
+        uint32_t runs;
+        uint32_t totalMicros;
+        uint32_t maxMicros;
+        uint32_t overruns; //Runs that went past the budget
+        uint32_t deferred; //Passes skipped because the pass budget was spent
+    } Task;
+    Task tasks[SCHEDULER_MAX_TASKS];
+    uint8_t taskCount = 0;
+    uint8_t criticalCount = 0; //Critical tasks sort to the front
+    uint32_t passes = 0;
+    uint32_t sliceStart = 0;
+    uint16_t sliceBudget = 0;
+    void RunTask(Task &t);
+    void RunCritical();
+public:
+    bool Add(const char* name, TaskFunction run, TaskPriority priority, uint16_t budget);
+    void Run();
+    bool SliceExpired();
+    void DumpStats();
+};
+
+extern Scheduler scheduler;
+#endif
@@ -1,5 +1,6 @@
 #ifndef VOICE_H_
 #define VOICE_H_
+#include <string.h>
 #define MAX_VOICES 64
 //Voice data
 static unsigned char currentProgram = 0;
@@ -16,6 +17,73 @@ typedef struct
   unsigned char C2[11];
 } Voice;
 
-static Voice voices[MAX_VOICES];
+//Per-operator YM2612 registers, in the order they are written
+enum VoiceImageRegister
+{
+  IMG_DT1MUL, IMG_TL, IMG_RSAR, IMG_AMD1R, IMG_D2R, IMG_D1LRR, IMG_OP_REGS
+};
+
+//A Voice compiled down to the bytes the YM2612 actually wants (26 bytes vs 56)
+//Operators are kept in OPM order: M1, C1, M2, C2
+typedef struct
+{
+  unsigned char OP[4][IMG_OP_REGS];
+  unsigned char FBALGO;
+  unsigned char LRAMSFMS;
+} VoiceImage;
+
+static VoiceImage voices[MAX_VOICES];
+
+static inline void CompileVoice(const Voice &v, VoiceImage &img)
+{
+  const unsigned char *ops[4] = {v.M1, v.C1, v.M2, v.C2};
+  for(int i = 0; i<4; i++)
+  {
+    const unsigned char *op = ops[i];
+    img.OP[i][IMG_DT1MUL] = (op[8] << 4) | op[7];
+    img.OP[i][IMG_TL] = op[5];
+    img.OP[i][IMG_RSAR] = (op[6] << 6) | op[0];
+    img.OP[i][IMG_AMD1R] = (op[10] << 7) | op[1];
+    img.OP[i][IMG_D2R] = op[2];
+    img.OP[i][IMG_D1LRR] = (op[4] << 4) | op[3];
+  }
+  img.FBALGO = (v.CH[1] << 3) | v.CH[2];
+  img.LRAMSFMS = 0xC0 | ((v.CH[3] & 0x03) << 4) | (v.CH[4] & 0x07); //Both speakers on
+}
+
+//Rebuild OPM fields from an image. LFO, PAN, SLOT, NE and DT2 are not used by the YM2612 and come back as defaults
+static inline void DecompileVoice(const VoiceImage &img, Voice &v)
+{
+  unsigned char *ops[4] = {v.M1, v.C1, v.M2, v.C2};
+  memset(&v, 0, sizeof(Voice));
+  v.CH[0] = 64;
+  v.CH[1] = (img.FBALGO >> 3) & 0x07;
+  v.CH[2] = img.FBALGO & 0x07;
+  v.CH[3] = (img.LRAMSFMS >> 4) & 0x03;
+  v.CH[4] = img.LRAMSFMS & 0x07;
+  v.CH[5] = 120;
+  for(int i = 0; i<4; i++)
+  {
+    unsigned char *op = ops[i];
+    op[0] = img.OP[i][IMG_RSAR] & 0x1F;
+    op[1] = img.OP[i][IMG_AMD1R] & 0x1F;
+    op[2] = img.OP[i][IMG_D2R];
+    op[3] = img.OP[i][IMG_D1LRR] & 0x0F;
+    op[4] = img.OP[i][IMG_D1LRR] >> 4;
+    op[5] = img.OP[i][IMG_TL];
+    op[6] = img.OP[i][IMG_RSAR] >> 6;
+    op[7] = img.OP[i][IMG_DT1MUL] & 0x0F;
+    op[8] = (img.OP[i][IMG_DT1MUL] >> 4) & 0x07;
+    op[10] = img.OP[i][IMG_AMD1R] >> 7;
+  }
+}
+
+//Update one packed field of an image register, clamping like the YM2612 setters do
+static inline void SetImageField(unsigned char &reg, unsigned char mask, unsigned char shift, unsigned char value)
+{
+  if(value > mask)
+    value = mask;
+  reg = (reg & ~(mask << shift)) | (value << shift);
+}
 
-#endif
\ No newline at end of file
+#endif
@@ -1,5 +1,8 @@
 #include "YM2612.h"
+#include "NoteLatency.h"
+#include "DataBus.h"
 
+static YM2612* queueOwner = NULL; //Instance serviced by the Timer2 ISR
 
 YM2612::YM2612()
 {
@@ -9,16 +12,101 @@ YM2612::YM2612()
     PORTC |= 0x3C; //_A1 LOW, _A0 LOW, _IC HIGH, _WR HIGH, _RD HIGH, _CS HIGH
     memset(bank0, 0, sizeof bank0); //Reset shadow registers
     memset(bank1, 0, sizeof bank1);
+    memset(slotVoice, 0, sizeof slotVoice);
+    ResetChannels();
+    queueOwner = this;
 }
 
 void YM2612::Reset()
 {
+    //Anything still queued was meant for the chip we are about to reset
+    uint8_t sreg = SREG;
+    cli();
+    TIMSK2 &= ~bit(OCIE2A);
+    queueTail = queueHead;
+    SREG = sreg;
+    noteLatency.Discard();
+
+    //Timer2 drains the write queue. CTC, /8 prescaler (2 counts per uS)
+    static_assert(YM_QUEUE_TICK > YM_DATA_DELAY, "The busy period must run out between drains");
+    TCCR2A = bit(WGM21);
+    TCCR2B = bit(CS21);
+    OCR2A = YM_QUEUE_TICK*2 - 1;
+
     digitalWriteFast(_IC, LOW);  //_IC HIGH
     delayMicroseconds(25);
     digitalWriteFast(_IC, HIGH); //_IC HIGH
     delayMicroseconds(25);
     memset(bank0, 0, sizeof bank0); //Reset shadow registers
     memset(bank1, 0, sizeof bank1);
+    for(int i = 0; i<3; i++) //Reset leaves both speakers on, everything else zeroed
+    {
+      bank0[0xB4+i-0x21] = 0xC0;
+      bank1[0xB4+i-0x30] = 0xC0;
+    }
+    shadowValid = true;
+}
+
+static inline unsigned char &SnapshotRegister(YM2612::RegisterSnapshot &snap, uint8_t addr, bool a1)
+{
+  return a1 ? snap.bank1[addr-0x30] : snap.bank0[addr-0x21];
+}
+
+static inline unsigned char SnapshotRegister(const YM2612::RegisterSnapshot &snap, uint8_t addr, bool a1)
+{
+  return a1 ? snap.bank1[addr-0x30] : snap.bank0[addr-0x21];
+}
+
+void YM2612::Snapshot(RegisterSnapshot &snap)
+{
+  memcpy(snap.bank0, bank0, sizeof bank0);
+  memcpy(snap.bank1, bank1, sizeof bank1);
+}
+
+//Bring the chip back to a snapshot, usually straight after Reset(). Only registers that
+//differ from the shadow are written: globals first, then operators, algorithm/pan,
+//and finally frequency so held notes come back at the right pitch.
+void YM2612::Restore(const RegisterSnapshot &snap, bool rekeyHeldNotes)
+{
+  send(0x22, snap.bank0[0x22-0x21]); // LFO
+  if(snap.bank0[0x27-0x21] != bank0[0x27-0x21])
+    send(0x27, snap.bank0[0x27-0x21]); // CH3 mode
+  send(0x2B, snap.bank0[0x2B-0x21]); // DAC enable
+
+  for(int a1 = 0; a1<=1; a1++)
+  {
+    for(uint8_t addr = 0x30; addr < 0xA0; addr++)
+      send(addr, SnapshotRegister(snap, addr, a1), a1);
+    for(uint8_t addr = 0xB0; addr < 0xB7; addr++)
+      send(addr, SnapshotRegister(snap, addr, a1), a1);
+    for(uint8_t i = 0; i<3; i++)
+    {
+      //0xA4 only latches, the 0xA0 write commits both halves
+      for(uint8_t fbase = 0xA0; fbase <= 0xA8; fbase += 0x08)
+      {
+        uint8_t lo = fbase + i;
+        uint8_t hi = fbase + 4 + i;
+        uint8_t loData = SnapshotRegister(snap, lo, a1);
+        uint8_t hiData = SnapshotRegister(snap, hi, a1);
+        if(loData != GetShadowValue(lo, a1) || hiData != GetShadowValue(hi, a1))
+        {
+          send(hi, hiData, a1);
+          send(lo, loData, a1);
+        }
+      }
+    }
+  }
+
+  if(!rekeyHeldNotes)
+  {
+    ResetChannels();
+    return;
+  }
+  for(uint8_t i = 0; i<MAX_CHANNELS_YM; i++)
+  {
+    if(channels[i].keyOn)
+      send(0x28, 0xF0 + i%3 + ((i > 2) << 2));
+  }
 }
 
 void YM2612::DumpShadowRegisters()
@@ -71,34 +159,296 @@ void YM2612::DumpShadowRegisters()
   }
 }
 
-void YM2612::send(unsigned char addr, unsigned char data, bool setA1)
+void YM2612::send(unsigned char addr, unsigned char data, bool setA1, bool latencyStamp)
 {
     //Store in shadow registers to keep track of written values
-    if(setA1)
+    unsigned char *shadow = setA1 ? &bank1[addr-0x30] : &bank0[addr-0x21];
+    if(shadowValid && *shadow == data && !IsTriggerRegister(addr))
     {
-      bank1[addr-0x30] = data;
+      writesElided++; //Chip already holds this value
+      return;
     }
-    else
+    *shadow = data;
+    writesIssued++;
+
+    uint8_t next = (queueHead + 1) & (YM_QUEUE_SIZE-1);
+    if(next == queueTail) //Queue full, make room ourselves instead of waiting on the timer
     {
-      bank0[addr-0x21] = data;
+      uint8_t sreg = SREG;
+      cli();
+      dataBus.Acquire(BUS_YM2612); //Never fails outside the ISR
+      SettleAfterDrain();
+      WriteNext(true);
+      dataBus.Release(BUS_YM2612);
+      SREG = sreg;
     }
-    
+    writeQueue[queueHead].addr = addr;
+    writeQueue[queueHead].data = data;
+    writeQueue[queueHead].setA1 = setA1;
+    writeQueue[queueHead].latencyStamp = latencyStamp;
+    queueHead = next;
+    TIMSK2 |= bit(OCIE2A);
+}
+
+bool YM2612::IsTriggerRegister(uint8_t addr)
+{
+  //These registers act on the write itself, not just the stored value
+  if(addr >= 0x24 && addr <= 0x28) //Timers, CH3 mode and key on/off
+    return true;
+  if(addr == 0x2A) //DAC data
+    return true;
+  if(addr >= 0xA0 && addr <= 0xAF) //Frequency. 0xA4-0xA6 only latch, 0xA0-0xA2 commit the latch
+    return true;
+  return false;
+}
+
+void YM2612::DumpWriteStats()
+{
+  Serial.print("Writes issued: "); Serial.println(writesIssued);
+  Serial.print("Writes elided: "); Serial.println(writesElided);
+}
+
+uint32_t YM2612::GetWritesIssued()
+{
+  return writesIssued;
+}
+
+uint8_t YM2612::Pending()
+{
+    return (queueHead - queueTail) & (YM_QUEUE_SIZE-1);
+}
+
+void YM2612::Flush()
+{
+    //Push everything queued out to the chip before returning
+    while(Pending())
+    {
+      uint8_t sreg = SREG;
+      cli();
+      dataBus.Acquire(BUS_YM2612); //Never fails outside the ISR
+      SettleAfterDrain();
+      WriteNext(true);
+      dataBus.Release(BUS_YM2612);
+      SREG = sreg;
+    }
+}
+
+void YM2612::WriteNext(bool settle) //Interrupts must be disabled
+{
+    if(queueTail == queueHead)
+      return;
+    QueuedWrite w = writeQueue[queueTail];
+    queueTail = (queueTail + 1) & (YM_QUEUE_SIZE-1);
+    write(w.addr, w.data, w.setA1, settle);
+    if(w.latencyStamp)
+      noteLatency.KeyOnWritten();
+}
+
+void YM2612::DrainWriteQueue()
+{
+    //The LCD or the PSG is part way through a byte on PORTF, leave the queue for the next tick
+    if(!dataBus.Acquire(BUS_YM2612))
+    {
+      dataBus.Defer();
+      return;
+    }
+    //One write per tick and no busy wait after it, the chip is ready again long before the next tick
+    WriteNext(false);
+    drainUnsettled = true;
+    dataBus.Release(BUS_YM2612);
+    if(queueTail == queueHead)
+      TIMSK2 &= ~bit(OCIE2A);
+}
+
+//The ISR leaves the chip busy after its write. A main-loop write can follow straight after it,
+//so let that busy period run out first. Polling waits on the flag before every write anyway
+void YM2612::SettleAfterDrain() //Interrupts must be disabled
+{
+    if(drainUnsettled && !busyPolling)
+      delayMicroseconds(YM_DATA_DELAY);
+    drainUnsettled = false;
+}
+
+ISR(TIMER2_COMPA_vect)
+{
+    queueOwner->DrainWriteQueue();
+}
+
+//Control lines on PORTC. PC6 (PSG clock) and PC7 (LCD RS) belong to someone else, and
+//_IC is only ever driven by Reset(), so those bits are carried through untouched.
+#define PC_IC (1 << 0)
+#define PC_CS (1 << 1)
+#define PC_WR (1 << 2)
+#define PC_RD (1 << 3)
+#define PC_A0 (1 << 4)
+#define PC_A1 (1 << 5)
+#define PC_KEEP (~(PC_CS | PC_WR | PC_RD | PC_A0 | PC_A1))
+#define YM_STROBE() __asm__ __volatile__ ("nop\n\tnop\n\tnop\n\tnop") //250nS /WR pulse
+
+//Poll the status register until the busy flag (D7) clears. Returns false on timeout
+//Interrupts must be disabled
+bool YM2612::WaitWhileBusy()
+{
+    uint16_t polls = 0;
+    uint8_t idle = (PORTC & PC_KEEP) | PC_CS | PC_WR | PC_RD;
+    DDRF = 0x00;
+    PORTF = 0x00; //No pullups on the bus
+    PORTC = idle & ~(PC_CS | PC_RD); //A1 & A0 low, read status
+    YM_STROBE();
+    while((PINF & 0x80) && polls < YM_BUSY_TIMEOUT)
+      polls++;
+    PORTC = idle;
+    DDRF = 0xFF;
+    busyWaits++;
+    busyPolls += polls;
+    if(polls > busyPollsMax)
+      busyPollsMax = polls;
+    if(polls < YM_BUSY_TIMEOUT)
+      return true;
+    busyTimeouts++;
+    return false;
+}
+
+//Each bus phase is one PORTC store to strobe /CS + /WR, one to release them and one to move A0/A1.
+//A0/A1 never change on the edge that latches the write, so the address hold time after /WR is kept
+//settle: wait out the busy period before returning. The ISR skips it and lets the gap to its next tick do that
+//Interrupts must be disabled
+void YM2612::write(unsigned char addr, unsigned char data, bool setA1, bool settle)
+{
+    bool polled = busyPolling && WaitWhileBusy();
+    uint8_t idle = (PORTC & PC_KEEP) | PC_CS | PC_WR | PC_RD | (setA1 ? PC_A1 : 0);
+
+    //Address
+    PORTC = idle;
+    PORTF = addr;
+    PORTC = idle & ~(PC_CS | PC_WR);
+    YM_STROBE();
+    PORTC = idle;
+    PORTC = idle | PC_A0;
+    delayMicroseconds(YM_ADDR_DELAY);
+
+    //Data
+    PORTF = data;
+    PORTC = (idle | PC_A0) & ~(PC_CS | PC_WR);
+    YM_STROBE();
+    PORTC = idle | PC_A0;
+    PORTC = idle & ~PC_A1;
+    if(settle && !polled) //Otherwise the next write waits on the busy flag instead
+      delayMicroseconds(YM_DATA_DELAY);
+}
+
+//The original pin-at-a-time bus driver, only kept so BenchmarkBus() has something to compare against.
+//Strobe width and the address/busy waits match write() so the two only differ in how the pins are driven
+//Interrupts must be disabled
+void YM2612::writePinByPin(unsigned char addr, unsigned char data, bool setA1)
+{
+    bool polled = busyPolling && WaitWhileBusy();
     digitalWriteFast(_A1, setA1);
     digitalWriteFast(_A0, LOW);
     digitalWriteFast(_CS, LOW);
     PORTF = addr;
     digitalWriteFast(_WR, LOW);
-    delayMicroseconds(1);
+    YM_STROBE();
     digitalWriteFast(_WR, HIGH);
     digitalWriteFast(_CS, HIGH);
     digitalWriteFast(_A0, HIGH);
+    delayMicroseconds(YM_ADDR_DELAY);
     digitalWriteFast(_CS, LOW);
     PORTF = data;
     digitalWriteFast(_WR, LOW);
-    delayMicroseconds(1);
+    YM_STROBE();
     digitalWriteFast(_WR, HIGH);
     digitalWriteFast(_CS, HIGH);
     digitalWriteFast(_A0, LOW);
+    if(!polled)
+      delayMicroseconds(YM_DATA_DELAY);
+}
+
+//Time a burst of register writes through both bus drivers and report writes per second.
+//Both pay the same YM_ADDR_DELAY and YM_DATA_DELAY (or busy poll) per write, the rest is the pin driving
+void YM2612::BenchmarkBus()
+{
+  const uint16_t writes = 1024;
+  uint32_t elapsed[2];
+  Flush();
+  for(uint8_t pass = 0; pass<2; pass++)
+  {
+    uint32_t start = micros();
+    for(uint16_t i = 0; i<writes; i++)
+    {
+      //Rewrite what the chip already holds so the burst is inaudible
+      uint8_t addr = 0x30 + (i & 0x3F);
+      uint8_t sreg = SREG;
+      cli();
+      dataBus.Acquire(BUS_YM2612);
+      if(pass == 0)
+        writePinByPin(addr, GetShadowValue(addr, 0), 0);
+      else
+        write(addr, GetShadowValue(addr, 0), 0);
+      dataBus.Release(BUS_YM2612);
+      SREG = sreg;
+    }
+    elapsed[pass] = micros() - start;
+  }
+  Serial.print("Pin by pin: "); Serial.print(1000000UL*writes/elapsed[0]); Serial.println(" writes/s");
+  Serial.print("Port masks: "); Serial.print(1000000UL*writes/elapsed[1]); Serial.print(" writes/s");
+  Serial.println(busyPolling ? " (busy polling)" : " (fixed delays)");
+  Serial.print("Delay budget per write, both drivers: "); Serial.print(YM_ADDR_DELAY); Serial.print("uS + ");
+  if(busyPolling)
+    Serial.println("busy poll");
+  else
+  {
+    Serial.print(YM_DATA_DELAY); Serial.println("uS");
+  }
+}
+
+bool YM2612::GetBusyPolling()
+{
+  return busyPolling;
+}
+
+void YM2612::SetBusyPolling(bool enabled)
+{
+  Flush();
+  busyPolling = enabled;
+  Serial.print("Busy polling: "); Serial.println(busyPolling ? "ON" : "OFF");
+}
+
+//Time the busy period after a burst of data writes and print the running poll statistics
+void YM2612::CalibrateBusy()
+{
+  const uint8_t writes = 64;
+  uint32_t busyMicros = 0;
+  uint32_t worstMicros = 0;
+  uint8_t timeouts = 0;
+  Flush();
+  for(uint8_t i = 0; i<writes; i++)
+  {
+    //Rewrite what the chip already holds so the burst is inaudible
+    uint8_t addr = 0x30 + i;
+    bool a1 = false;
+    uint8_t sreg = SREG;
+    cli();
+    dataBus.Acquire(BUS_YM2612);
+    write(addr, GetShadowValue(addr, a1), a1);
+    uint32_t start = micros();
+    if(!WaitWhileBusy())
+      timeouts++;
+    uint32_t elapsed = micros() - start;
+    dataBus.Release(BUS_YM2612);
+    SREG = sreg;
+    busyMicros += elapsed;
+    if(elapsed > worstMicros)
+      worstMicros = elapsed;
+  }
+  Serial.print("Avg busy after data write: "); Serial.print(busyMicros/writes); Serial.println("uS");
+  Serial.print("Worst busy: "); Serial.print(worstMicros); Serial.println("uS");
+  Serial.print("Calibration timeouts: "); Serial.println(timeouts);
+  Serial.print("Busy polling: "); Serial.println(busyPolling ? "ON" : "OFF");
+  Serial.print("Waits: "); Serial.print(busyWaits);
+  Serial.print(" Avg polls: "); Serial.print(busyWaits ? busyPolls/busyWaits : 0);
+  Serial.print(" Max polls: "); Serial.print(busyPollsMax);
+  Serial.print(" Timeouts: "); Serial.println(busyTimeouts);
 }
 
 void YM2612::SetFrequency(uint16_t frequency, uint8_t channel)
@@ -113,6 +463,10 @@ void YM2612::SetFrequency(uint16_t frequency, uint8_t channel)
   }
   frq = (uint16_t)frequency;
   bool setA1 = channel > 2;
+  uint8_t hi = ((frq >> 8) & mask(3)) | ((block & mask(3)) << 3);
+  uint8_t lo = frq;
+  if(hi == GetShadowValue(0xA4 + channel%3, setA1) && lo == GetShadowValue(0xA0 + channel%3, setA1))
+    return; //Already there, common with fine bends
 
   // unsigned char f1 = ((frq >> 8) & mask(3)) | ((block & mask(3)) << 3);
   // unsigned char f2 = frq;
@@ -123,174 +477,245 @@ void YM2612::SetFrequency(uint16_t frequency, uint8_t channel)
   // Serial.println(0xA4+channel%3, HEX);
   // Serial.println("-------");
 
-  send(0xA4 + channel%3, ((frq >> 8) & mask(3)) | ((block & mask(3)) << 3), setA1);
-  send(0xA0 + channel%3, frq, setA1);
+  send(0xA4 + channel%3, hi, setA1);
+  send(0xA0 + channel%3, lo, setA1);
 }
 
-float YM2612::NoteToFrequency(uint8_t note)
+//Elegant note/freq system by diegodorado
+//Check out his project at https://github.com/diegodorado/arduinoProjects/tree/master/ym2612
+//The table below is generated by the compiler from these, so there is no float math left at runtime
+static constexpr float noteFreq[12] = 
 {
-    //Elegant note/freq system by diegodorado
-    //Check out his project at https://github.com/diegodorado/arduinoProjects/tree/master/ym2612
-    const static float freq[12] = 
-    {
-      //You can create your own note frequencies here. C4#-C5. There should be twelve entries.
-      //YM3438 datasheet note set
-      277.2, 293.7, 311.1, 329.6, 349.2, 370.0, 392.0, 415.3, 440.0, 466.2, 493.9, 523.3
+  //You can create your own note frequencies here. C4#-C5. There should be twelve entries.
+  //YM3438 datasheet note set
+  277.2, 293.7, 311.1, 329.6, 349.2, 370.0, 392.0, 415.3, 440.0, 466.2, 493.9, 523.3
+};
+static constexpr float octaveMultiplier[YM_OCTAVES] = 
+{
+  0.03125f,   0.0625f,   0.125f,   0.25f,   0.5f,   1.0f,   2.0f,   4.0f,   8.0f,   16.0f,   32.0f 
+};
+//Evaluated in float like the old runtime code (double is float on the AVR) so the truncated results match
+static constexpr uint16_t NoteFNumber(uint8_t octave, uint8_t semitone)
+{
+  return (uint16_t)((noteFreq[semitone] + noteFreq[semitone]*(float)TUNE) * octaveMultiplier[octave]);
+}
+#define FNUM_OCTAVE(o) { NoteFNumber(o, 0), NoteFNumber(o, 1), NoteFNumber(o, 2), NoteFNumber(o, 3), \
+                         NoteFNumber(o, 4), NoteFNumber(o, 5), NoteFNumber(o, 6), NoteFNumber(o, 7), \
+                         NoteFNumber(o, 8), NoteFNumber(o, 9), NoteFNumber(o, 10), NoteFNumber(o, 11) }
+//F-number before block scaling (see SetFrequency()), indexed by octave (note/12 + octave shift) and semitone
+static const uint16_t fNumberTable[YM_OCTAVES][12] PROGMEM = 
+{
+  FNUM_OCTAVE(0), FNUM_OCTAVE(1), FNUM_OCTAVE(2), FNUM_OCTAVE(3), FNUM_OCTAVE(4), FNUM_OCTAVE(5),
+  FNUM_OCTAVE(6), FNUM_OCTAVE(7), FNUM_OCTAVE(8), FNUM_OCTAVE(9), FNUM_OCTAVE(10)
+};
+
+uint16_t YM2612::NoteToFrequency(int16_t note)
+{
+    if(note < 0)
+      note = 0;
+    int8_t octave = note/12 + octaveShift;
+    if(octave < 0)
+      octave = 0;
+    else if(octave >= YM_OCTAVES)
+      octave = YM_OCTAVES-1;
+    return pgm_read_word(&fNumberTable[octave][note%12]);
+}
 
-    }; 
-    const static float multiplier[] = 
+//Linear interpolation between the notes pitchBendYMRange either side of the key. 14 bit fixed point fraction
+uint16_t YM2612::BendFrequency(uint8_t key, int pitch)
+{
+    uint16_t freqFrom = NoteToFrequency(key-pitchBendYMRange);
+    int16_t span = NoteToFrequency(key+pitchBendYMRange) - freqFrom; //Negative where the top octave is clamped
+    return freqFrom + (((int32_t)(pitch + 8192) * span) >> 14);
+}
+
+void YM2612::ResetChannels()
+{
+    memset(noteMap, YM_NO_CHANNEL, sizeof noteMap);
+    freeHead = freeTail = activeHead = activeTail = YM_NO_CHANNEL;
+    for(uint8_t i = 0; i<MAX_CHANNELS_YM; i++)
     {
-      0.03125f,   0.0625f,   0.125f,   0.25f,   0.5f,   1.0f,   2.0f,   4.0f,   8.0f,   16.0f,   32.0f 
-    }; 
-    float f = freq[note%12];
-    return (f+(f*TUNE))*multiplier[(note/12)+octaveShift];
+      channels[i].keyOn = false;
+      channels[i].sustained = false;
+      channels[i].fixed = false;
+      ListAppend(freeHead, freeTail, i);
+    }
+}
+
+void YM2612::ListRemove(uint8_t &head, uint8_t &tail, uint8_t ch)
+{
+    Channel &c = channels[ch];
+    if(c.prev == YM_NO_CHANNEL)
+      head = c.next;
+    else
+      channels[c.prev].next = c.next;
+    if(c.next == YM_NO_CHANNEL)
+      tail = c.prev;
+    else
+      channels[c.next].prev = c.prev;
+    c.prev = c.next = YM_NO_CHANNEL;
+}
+
+void YM2612::ListAppend(uint8_t &head, uint8_t &tail, uint8_t ch)
+{
+    Channel &c = channels[ch];
+    c.prev = tail;
+    c.next = YM_NO_CHANNEL;
+    if(tail == YM_NO_CHANNEL)
+      head = ch;
+    else
+      channels[tail].next = ch;
+    tail = ch;
+}
+
+//Keys past the top of noteMap (the last notes plus SEMITONE_ADJ_YM) play an octave lower instead of being dropped
+uint8_t YM2612::FoldKey(uint8_t key)
+{
+    while(key >= YM_KEYS)
+      key -= 12;
+    return key;
 }
 
-uint8_t chIndex = 0;
 void YM2612::SetChannelOn(uint8_t key, uint8_t velocity, bool velocityEnabled)
 {
-    uint8_t openChannel = 0xFF;
-    for(int i = 0; i<MAX_CHANNELS_YM; i++)
+    key = FoldKey(key);
+    uint8_t openChannel = noteMap[key];
+    if(openChannel != YM_NO_CHANNEL) //Same key again (ie: sustained), retrigger it on its own channel
     {
-        if(!channels[i].keyOn || channels[i].keyNumber == key)
-        {
-            if(channels[i].keyNumber == key && channels[i].sustained)
-            {
-              //Turn off the sustained channel before turning it back on again
-              uint8_t offset = i % 3;
-              bool setA1 = i > 2;
-              send(0x28, 0x00 + offset + (setA1 << 2));
-            }
-            channels[i].keyOn = true;
-            channels[i].keyNumber = key;
-            channels[i].blockNumber = key/12;
-            channels[i].sustained = YMsustainEnabled;
-            channels[i].index = chIndex;
-            openChannel = i;
-            break;
-        }
+      ListRemove(activeHead, activeTail, openChannel);
+      send(0x28, 0x00 + openChannel%3 + ((openChannel > 2) << 2));
     }
-    uint8_t highestIndex = 0xFF;
-    if(openChannel == 0xFF) //All channels full, kill the oldest note
+    else if(freeHead != YM_NO_CHANNEL) //Released channels first, the one released longest ago has decayed the most
     {
-      for(int i = 0; i<MAX_CHANNELS_YM; i++)
-      {
-        if(channels[i].index < highestIndex)
-          highestIndex = channels[i].index;
-      }
-      uint8_t offset = highestIndex % 3;
-      bool setA1 = highestIndex > 2;
-      send(0x28, 0x00 + offset + (setA1 << 2));
-      channels[highestIndex].keyOn = true;
-      channels[highestIndex].keyNumber = key;
-      channels[highestIndex].blockNumber = key/12;
-      channels[highestIndex].sustained = YMsustainEnabled;
-      channels[highestIndex].index = chIndex;
-      openChannel = highestIndex;
+      openChannel = freeHead;
+      ListRemove(freeHead, freeTail, openChannel);
     }
-    chIndex++;
-    chIndex %= MAX_CHANNELS_YM;
-
-    uint8_t offset = openChannel % 3;
-    bool setA1 = openChannel > 2;
+    else if(activeHead != YM_NO_CHANNEL) //All channels keyed on, steal the oldest note
+    {
+      openChannel = activeHead;
+      ListRemove(activeHead, activeTail, openChannel);
+      if(noteMap[channels[openChannel].keyNumber] == openChannel)
+        noteMap[channels[openChannel].keyNumber] = YM_NO_CHANNEL;
+      send(0x28, 0x00 + openChannel%3 + ((openChannel > 2) << 2));
+    }
+    else //Both lists empty, every channel is playing a fixed note. Those are never stolen, drop this one
+      return;
+    ListAppend(activeHead, activeTail, openChannel);
+    noteMap[key] = openChannel;
+    channels[openChannel].fixed = false;
+    channels[openChannel].sustained = YMsustainEnabled;
+    channels[openChannel].pitchBend = pitchBendYM;
+    KeyOnChannel(openChannel, key, velocity, velocityEnabled);
+}
 
-    if(pitchBendYM == 0)
+//One note per channel (YM_VST_1..YM_VST_6), bent by its own MIDI channel. Takes the channel from the allocator
+void YM2612::SetFixedChannelOn(uint8_t channel, uint8_t key, uint8_t velocity)
+{
+    if(channel >= MAX_CHANNELS_YM)
+      return;
+    key = FoldKey(key);
+    Channel &c = channels[channel];
+    if(c.keyOn)
     {
-      SetFrequency(NoteToFrequency(key), openChannel);
+      if(!c.fixed) //A fixed note is on neither list
+        ListRemove(activeHead, activeTail, channel);
+      if(noteMap[c.keyNumber] == channel)
+        noteMap[c.keyNumber] = YM_NO_CHANNEL;
+      send(0x28, 0x00 + channel%3 + ((channel > 2) << 2));
     }
     else
     {
-      float freqFrom = NoteToFrequency(key-pitchBendYMRange);
-      float freqTo = NoteToFrequency(key+pitchBendYMRange);
-      SetFrequency(map(pitchBendYM, -8192, 8192, freqFrom, freqTo), openChannel);
+      ListRemove(freeHead, freeTail, channel);
     }
-    if(velocityEnabled)
-    {
-      uint8_t s_FBALGO = GetShadowValue(0xB0, 0);
-      uint8_t algo = 0b00000111 & s_FBALGO;
-      uint8_t fb = 0b00111000 & s_FBALGO;
-      velocity = 127-velocity;
-      for(int a1 = 0; a1<=1; a1++)
-      {
-        for(int i = 0; i<3; i++)
-        {
-          switch(algo)
-          {
-            case 0:
-            case 1:
-            case 2:
-            case 3:
-            {
-              //Algos 0-3 all use OP.4 as the "slot" (AKA output or carrier)
-              send(0x4C+i, velocity, a1);
-              break;
-            }
-            case 4:
-            {
-              //OP.2 & OP.4
-              send(0x44+i, velocity, a1);
-              send(0x4C+i, velocity, a1);
-              break;
-            }
-            case 5:
-            case 6:
-            {
-              //Algos 5-6 use OP.2 & OP.3 & OP.4
-              send(0x44+i, velocity, a1);
-              send(0x48+i, velocity, a1);
-              send(0x4C+i, velocity, a1);
-              break;
-            }
-            case 7:
-            {
-              //This algo uses every operator as a slot
-              send(0x40+i, velocity, a1);
-              send(0x44+i, velocity, a1);
-              send(0x48+i, velocity, a1);
-              send(0x4C+i, velocity, a1);
-              break;
-            }
-          }
-        }
-      }
-    }
-    send(0x28, 0xF0 + offset + (setA1 << 2));  
+    c.fixed = true; //Out of the allocator until it is released, so normal notes cannot steal it
+    c.sustained = false;
+    KeyOnChannel(channel, key, velocity, true);
+}
+
+void YM2612::KeyOnChannel(uint8_t channel, uint8_t key, uint8_t velocity, bool velocityEnabled)
+{
+    channels[channel].keyOn = true;
+    channels[channel].keyNumber = key;
+    channels[channel].blockNumber = key/12;
+    SetFrequency(ChannelFrequency(channel), channel);
+    SetChannelVelocity(channel, velocityEnabled ? velocity : 127);
+    //Stamp first: the Timer2 drain may write the key-on before send() even returns
+    send(0x28, 0xF0 + channel%3 + ((channel > 2) << 2), false, noteLatency.KeyOnQueued());
+}
+
+//Carrier ("slot") operators for each algorithm. Bit n = operator n in OPM order (M1, C1, M2, C2)
+static const uint8_t carrierOperators[8] = {0x08, 0x08, 0x08, 0x08, 0x0A, 0x0E, 0x0E, 0x0F};
+
+//Attenuate this channel's carriers relative to the patch TL. Full velocity puts the patch TL back
+void YM2612::SetChannelVelocity(uint8_t channel, uint8_t velocity)
+{
+  channels[channel].attenuation = pgm_read_byte(&velocityCurveYM[(velocity & 0x7F) >> 2]);
+  WriteChannelTL(channel);
+}
+
+//TL the chip should hold for an operator: the patch TL, plus the channel's velocity if it is a carrier
+uint8_t YM2612::ChannelTL(uint8_t channel, uint8_t op)
+{
+  const VoiceImage &v = slotVoice[channel];
+  uint16_t tl = v.OP[op][IMG_TL];
+  if(carrierOperators[v.FBALGO & 0x07] & (1 << op))
+    tl += channels[channel].attenuation;
+  return tl > 0x7F ? 0x7F : tl;
+}
+
+//Every TL write goes through here so patch edits never undo the velocity of a sounding note
+void YM2612::WriteChannelTL(uint8_t channel)
+{
+  bool a1 = channel > 2;
+  uint8_t slot = channel % 3;
+  for(uint8_t op = 0; op<4; op++)
+    send(0x40 + op*4 + slot, ChannelTL(channel, op), a1);
 }
 
 uint8_t YM2612::GetShadowValue(uint8_t addr, bool bank)
 {
   return bank ? bank1[addr-0x30] : bank0[addr-0x21];
 }
-
 void YM2612::SetChannelOff(uint8_t key)
 {
-    uint8_t closedChannel = 0xFF;
-    for(int i = 0; i<MAX_CHANNELS_YM; i++)
-    {
-        if(channels[i].keyNumber == key)
-        {
-            if(channels[i].sustained)
-              continue;
-            channels[i].keyOn = false;
-            closedChannel = i;
-            break;
-        }
-    }
-    if(closedChannel == 0xFF)
-        return;
-    uint8_t offset = closedChannel % 3;
-    bool setA1 = closedChannel > 2;
-    send(0x28, 0x00 + offset + (setA1 << 2));
+    key = FoldKey(key);
+    uint8_t closedChannel = noteMap[key];
+    if(closedChannel == YM_NO_CHANNEL || channels[closedChannel].sustained)
+      return;
+    ReleaseChannel(closedChannel);
+}
+
+void YM2612::SetFixedChannelOff(uint8_t channel, uint8_t key)
+{
+    if(channel >= MAX_CHANNELS_YM)
+      return;
+    Channel &c = channels[channel];
+    if(!c.fixed || !c.keyOn || c.keyNumber != FoldKey(key)) //Stolen or already retriggered
+      return;
+    ReleaseChannel(channel);
 }
 
+void YM2612::ReleaseChannel(uint8_t channel)
+{
+    Channel &c = channels[channel];
+    c.keyOn = false;
+    c.releasedAt = millis();
+    if(noteMap[c.keyNumber] == channel)
+      noteMap[c.keyNumber] = YM_NO_CHANNEL;
+    if(!c.fixed)
+      ListRemove(activeHead, activeTail, channel);
+    ListAppend(freeHead, freeTail, channel); //Released fixed channels go back to the allocator
+    send(0x28, 0x00 + channel%3 + ((channel > 2) << 2));
+}
+//Pedal up. Works on the channels directly, the key-offs go out back to back in the write queue
 void YM2612::ReleaseSustainedKeys()
 {
-  for(int i = 0; i<MAX_CHANNELS_YM; i++)
+  for(uint8_t i = 0; i<MAX_CHANNELS_YM; i++)
   {
     if(channels[i].sustained && channels[i].keyOn)
     {
       channels[i].sustained = false;
-      SetChannelOff(channels[i].keyNumber);
+      ReleaseChannel(i);
     }
   }
 }
@@ -299,172 +724,75 @@ void YM2612::ClampSustainedKeys()
 {
   for(int i = 0; i<MAX_CHANNELS_YM; i++)
   {
-    if(!channels[i].sustained && channels[i].keyOn)
+    if(!channels[i].sustained && channels[i].keyOn && !channels[i].fixed)
     {
       channels[i].sustained = true;
     }
   }
 }
 
-void YM2612::SetVoiceManual(uint8_t slot, Voice v)
-{
-    SetFMFeedback(slot, v.CH[1]);
-    SetAlgo(slot, v.CH[2]);
-    SetAMSens(slot, v.CH[3]);
-    SetFreqModSens(slot, v.CH[4]);
-
-    SetAR(slot, 0, v.M1[0]);
-    SetD1R(slot, 0, v.M1[1]);
-    SetD2R(slot, 0, v.M1[2]);
-    SetRR(slot, 0, v.M1[3]);
-    SetD1L(slot, 0, v.M1[4]);
-    SetTL(slot, 0, v.M1[5]);
-    SetRateScaling(slot, 0, v.M1[6]);
-    SetMult(slot, 0, v.M1[7]);
-    SetDetune(slot, 0, v.M1[8]);
-    SetAmplitudeModulation(slot, 0, v.M1[10]);
-
-    SetAR(slot, 1, v.C1[0]);
-    SetD1R(slot, 1, v.C1[1]);
-    SetD2R(slot, 1, v.C1[2]);
-    SetRR(slot, 1, v.C1[3]);
-    SetD1L(slot, 1, v.C1[4]);
-    SetTL(slot, 1, v.C1[5]);
-    SetRateScaling(slot, 1, v.C1[6]);
-    SetMult(slot, 1, v.C1[7]);
-    SetDetune(slot, 1, v.C1[8]);
-    SetAmplitudeModulation(slot, 1, v.C1[10]);
-
-    SetAR(slot, 2, v.M2[0]);
-    SetD1R(slot, 2, v.M2[1]);
-    SetD2R(slot, 2, v.M2[2]);
-    SetRR(slot, 2, v.M2[3]);
-    SetD1L(slot, 2, v.M2[4]);
-    SetTL(slot, 2, v.M2[5]);
-    SetRateScaling(slot, 2, v.M2[6]);
-    SetMult(slot, 2, v.M2[7]);
-    SetDetune(slot, 2, v.M2[8]);
-    SetAmplitudeModulation(slot, 2, v.M2[10]);
-
-    SetAR(slot, 3, v.C2[0]);
-    SetD1R(slot, 3, v.C2[1]);
-    SetD2R(slot, 3, v.C2[2]);
-    SetRR(slot, 3, v.C2[3]);
-    SetD1L(slot, 3, v.C2[4]);
-    SetTL(slot, 3, v.C2[5]);
-    SetRateScaling(slot, 3, v.C2[6]);
-    SetMult(slot, 3, v.C2[7]);
-    SetDetune(slot, 3, v.C2[8]);
-    SetAmplitudeModulation(slot, 3, v.C2[10]);
-}
-
-void YM2612::SetVoice(Voice v)
-{
-  currentVoice = v;
-  bool resetLFO = lfoOn;
-  if(lfoOn)
-    ToggleLFO();
-  send(0x22, 0x00); // LFO off
-  send(0x27, 0x00); // CH3 Normal
-  send(0x28, 0x00); // Turn off all channels
-  send(0x2B, 0x00); // DAC off
+void YM2612::SetVoiceManual(uint8_t slot, VoiceImage v)
+{
+  uint8_t lfoAM = lfoOn ? 1 << 7 : 0;
+  uint8_t lrAmsFms = lfoOn ? 0xC0 + (3 << 4) + lfoSens : v.LRAMSFMS;
+  WriteVoiceSlot(slot, v, lfoAM, lrAmsFms);
+}
 
-  for(int a1 = 0; a1<=1; a1++)
+//Register base for each byte of a VoiceImage operator
+static const uint8_t opRegisters[IMG_OP_REGS] = {0x30, 0x40, 0x50, 0x60, 0x70, 0x80}; //DT1/Mul, TL, RS/AR, AM/D1R, D2R, D1L/RR
+
+void YM2612::WriteVoiceSlot(uint8_t slot, const VoiceImage &v, uint8_t lfoAM, uint8_t lrAmsFms)
+{
+  uint8_t channel = slot;
+  slotVoice[channel] = v;
+  bool a1 = (slot > 2);
+  slot %= 3;
+  for(int op = 0; op<4; op++)
   {
-    for(int i=0; i<3; i++)
+    for(int r = 0; r<IMG_OP_REGS; r++)
     {
-          uint8_t DT1MUL, TL, RSAR, AMD1R, D2R, D1LRR = 0;
-
-          //Operator 1
-          DT1MUL = (v.M1[8] << 4) | v.M1[7];
-          TL = v.M1[5];
-          RSAR = (v.M1[6] << 6) | v.M1[0];
-          AMD1R = (v.M1[10] << 7) | v.M1[1];
-          D2R = v.M1[2];
-          D1LRR = (v.M1[4] << 4) | v.M1[3];
-
-          // if(i == 0 && a1 == 0)
-          // {
-          // Serial.println("-----OPERATOR 1, A0-----");
-          // Serial.print("DT1MUL: "); Serial.println(DT1MUL, HEX);
-          // Serial.print("TL: "); Serial.println(TL, HEX);
-          // Serial.print("RSAR: "); Serial.println(RSAR, HEX);
-          // Serial.print("AMD1R: "); Serial.println(AMD1R, HEX);
-          // Serial.print("D2R: "); Serial.println(D2R, HEX);
-          // Serial.print("D1LRR: "); Serial.println(D1LRR, HEX);
-          // }
-
-          // Serial.println();
-          // if(i == 0 && a1 == 1)
-          // {
-          // Serial.println("-----OPERATOR 1, A1-----");
-          // Serial.print("DT1MUL: "); Serial.println(DT1MUL, HEX);
-          // Serial.print("TL: "); Serial.println(TL, HEX);
-          // Serial.print("RSAR: "); Serial.println(RSAR, HEX);
-          // Serial.print("AMD1R: "); Serial.println(AMD1R, HEX);
-          // Serial.print("D2R: "); Serial.println(D2R, HEX);
-          // Serial.print("D1LRR: "); Serial.println(D1LRR, HEX);
-          // }
-
-          send(0x30 + i, DT1MUL, a1); //DT1/Mul
-          send(0x40 + i, TL, a1); //Total Level
-          send(0x50 + i, RSAR, a1); //RS/AR
-          send(0x60 + i, AMD1R, a1); //AM/D1R
-          send(0x70 + i, D2R, a1); //D2R
-          send(0x80 + i, D1LRR, a1); //D1L/RR
-          send(0x90 + i, 0x00, a1); //SSG EG
-          
-          //Operator 2
-          DT1MUL = (v.C1[8] << 4) | v.C1[7];
-          TL = v.C1[5];
-          RSAR = (v.C1[6] << 6) | v.C1[0];
-          AMD1R = (v.C1[10] << 7) | v.C1[1];
-          D2R = v.C1[2];
-          D1LRR = (v.C1[4] << 4) | v.C1[3];
-          send(0x34 + i, DT1MUL, a1); //DT1/Mul
-          send(0x44 + i, TL, a1); //Total Level
-          send(0x54 + i, RSAR, a1); //RS/AR
-          send(0x64 + i, AMD1R, a1); //AM/D1R
-          send(0x74 + i, D2R, a1); //D2R
-          send(0x84 + i, D1LRR, a1); //D1L/RR
-          send(0x94 + i, 0x00, a1); //SSG EG
-           
-          //Operator 3
-          DT1MUL = (v.M2[8] << 4) | v.M2[7];
-          TL = v.M2[5];
-          RSAR = (v.M2[6] << 6) | v.M2[0];
-          AMD1R = (v.M2[10] << 7) | v.M2[1];
-          D2R = v.M2[2];
-          D1LRR = (v.M2[4] << 4) | v.M2[3];
-          send(0x38 + i, DT1MUL, a1); //DT1/Mul
-          send(0x48 + i, TL, a1); //Total Level
-          send(0x58 + i, RSAR, a1); //RS/AR
-          send(0x68 + i, AMD1R, a1); //AM/D1R
-          send(0x78 + i, D2R, a1); //D2R
-          send(0x88 + i, D1LRR, a1); //D1L/RR
-          send(0x98 + i, 0x00, a1); //SSG EG
-                   
-          //Operator 4
-          DT1MUL = (v.C2[8] << 4) | v.C2[7];
-          TL = v.C2[5];
-          RSAR = (v.C2[6] << 6) | v.C2[0];
-          AMD1R = (v.C2[10] << 7) | v.C2[1];
-          D2R = v.C2[2];
-          D1LRR = (v.C2[4] << 4) | v.C2[3];
-          send(0x3C + i, DT1MUL, a1); //DT1/Mul
-          send(0x4C + i, TL, a1); //Total Level
-          send(0x5C + i, RSAR, a1); //RS/AR
-          send(0x6C + i, AMD1R, a1); //AM/D1R
-          send(0x7C + i, D2R, a1); //D2R
-          send(0x8C + i, D1LRR, a1); //D1L/RR
-          send(0x9C + i, 0x00, a1); //SSG EG
-
-          uint8_t FBALGO = (v.CH[1] << 3) | v.CH[2];
-          send(0xB0 + i, FBALGO, a1); // Ch FB/Algo
-          send(0xB4 + i, 0xC0, a1); // Both Spks on
-
-          send(0x28, 0x00 + i + (a1 << 2)); //Keys off
+      uint8_t data = v.OP[op][r];
+      if(r == IMG_AMD1R)
+        data |= lfoAM;
+      else if(r == IMG_TL)
+        data = ChannelTL(channel, op); //Delta changes must not bring held notes back to full level
+      send(opRegisters[r] + op*4 + slot, data, a1);
     }
+    send(0x90 + op*4 + slot, 0x00, a1); //SSG EG
+  }
+  send(0xB0 + slot, v.FBALGO, a1); // Ch FB/Algo
+  send(0xB4 + slot, lrAmsFms, a1); // Speakers, AMS, FMS
+}
+
+//The voice a channel is playing. Not the shadow registers, those hold velocity and the LFO's forced AM
+VoiceImage YM2612::GetSlotImage(uint8_t slot)
+{
+  return slotVoice[slot];
+}
+
+//Delta mode leaves sounding notes and the LFO alone and only touches operator/channel
+//registers. Anything already matching the shadow registers is elided by send(), so a
+//change between similar patches costs a handful of bus writes instead of ~190.
+void YM2612::SetVoice(VoiceImage v, bool delta)
+{
+  bool resetLFO = lfoOn && !delta;
+  if(resetLFO)
+    ToggleLFO();
+  uint8_t lfoAM = (delta && lfoOn) ? 1 << 7 : 0; //ToggleLFO() forces AM on every operator
+  uint8_t lrAmsFms = (delta && lfoOn) ? 0xC0 + (3 << 4) + lfoSens : v.LRAMSFMS;
+  if(!delta)
+  {
+    send(0x22, 0x00); // LFO off
+    send(0x27, 0x00); // CH3 Normal
+    send(0x28, 0x00); // Turn off all channels
+    send(0x2B, 0x00); // DAC off
+  }
+
+  for(int ch = 0; ch<MAX_CHANNELS_YM; ch++)
+  {
+    WriteVoiceSlot(ch, v, lfoAM, lrAmsFms);
+    if(!delta)
+      send(0x28, 0x00 + ch%3 + ((ch > 2) << 2)); //Keys off
   }
   if(resetLFO)
     ToggleLFO();
@@ -494,61 +822,88 @@ void YM2612::AdjustLFO(uint8_t value)
     }
 }
 
+uint16_t YM2612::ChannelFrequency(uint8_t channel)
+{
+    if(channels[channel].pitchBend == 0)
+      return NoteToFrequency(channels[channel].keyNumber);
+    return BendFrequency(channels[channel].keyNumber, channels[channel].pitchBend);
+}
+
+//Bend a single channel. Only the latest bend matters, UpdatePitchBend() applies it once per loop
 void YM2612::AdjustPitch(uint8_t channel, int pitch)
 {
-    float freqFrom = NoteToFrequency(channels[channel].keyNumber-pitchBendYMRange);
-    float freqTo = NoteToFrequency(channels[channel].keyNumber+pitchBendYMRange);
+    if(channel >= MAX_CHANNELS_YM)
+      return;
+    channels[channel].pitchBend = pitch;
+    bendPending |= 1 << channel;
+}
+
+//Bend every channel that is not bent on its own (YM_VST_1..YM_VST_6), and every note played after this
+void YM2612::SetPitchBend(int pitch)
+{
     pitchBendYM = pitch;
-    SetFrequency(map(pitch,-8192, 8192, freqFrom, freqTo), channel);
+    for(uint8_t i = 0; i<MAX_CHANNELS_YM; i++)
+    {
+      if(!channels[i].fixed)
+        AdjustPitch(i, pitch);
+    }
+}
+
+void YM2612::UpdatePitchBend()
+{
+    if(!bendPending)
+      return;
+    uint32_t now = millis();
+    for(uint8_t i = 0; i<MAX_CHANNELS_YM; i++)
+    {
+      if(!(bendPending & (1 << i)))
+        continue;
+      if(channels[i].keyOn || now - channels[i].releasedAt < YM_RELEASE_BEND_MS)
+        SetFrequency(ChannelFrequency(i), i);
+    }
+    bendPending = 0;
 }
 
 void YM2612::ToggleLFO()
 {
   lfoOn = !lfoOn;
   Serial.print("LFO: "); Serial.println(lfoOn == true ? "ON": "OFF");
-  Voice v = currentVoice;
-  uint8_t AMD1R = 0;
   if(lfoOn)
   {
     uint8_t lfo = (1 << 3) | lfoFrq;
     send(0x22, lfo);
-    //This is a bulky way to do this, but it works so....
+    uint8_t lrAmsFms = 0xC0 + (3 << 4);
+    lrAmsFms |= lfoSens;
     for(int a1 = 0; a1<=1; a1++)
     {
       for(int i=0; i<3; i++)
       {
-        //Op. 1
-        AMD1R = (v.M1[10] << 7) | v.M1[1];
-        AMD1R |= 1 << 7;
-        send(0x60 + i, AMD1R, a1); 
-
-        //Op. 2
-        AMD1R = (v.C1[10] << 7) | v.C1[1];
-        AMD1R |= 1 << 7;
-        send(0x64 + i, AMD1R, a1); 
-
-        //Op. 3
-        AMD1R = (v.M2[10] << 7) | v.M2[1];
-        AMD1R |= 1 << 7;
-        send(0x68 + i, AMD1R, a1); 
-
-        //Op. 4
-        AMD1R = (v.C2[10] << 7) | v.C2[1];
-        AMD1R |= 1 << 7;
-        send(0x6C + i, AMD1R, a1); 
-
-        uint8_t lrAmsFms = 0xC0 + (3 << 4);
-        lrAmsFms |= lfoSens;
+        const VoiceImage &v = slotVoice[i + a1*3];
+        for(int op = 0; op<4; op++)
+          send(0x60 + op*4 + i, v.OP[op][IMG_AMD1R] | (1 << 7), a1); //AM on
         send(0xB4 + i, lrAmsFms, a1); // Speaker and LMS
       }
     }
   }
   else
   {
-    send(0x22, 0x00); // LFO off
+    //Reset to stop the LFO dead, then bring everything else back as it was, minus the forced AM
+    static RegisterSnapshot snap;
+    Snapshot(snap);
+    snap.bank0[0x22-0x21] = 0x00; // LFO off
+    for(int a1 = 0; a1<=1; a1++)
+    {
+      for(int i=0; i<3; i++)
+      {
+        const VoiceImage &v = slotVoice[i + a1*3];
+        for(int op = 0; op<4; op++)
+          SnapshotRegister(snap, 0x60 + op*4 + i, a1) = v.OP[op][IMG_AMD1R];
+        SnapshotRegister(snap, 0xB4 + i, a1) = v.LRAMSFMS;
+      }
+    }
     Reset();
     delay(1);
-    SetVoice(v);
+    Restore(snap, true);
   }
   digitalWriteFast(leds[0], lfoOn);
 }
@@ -579,25 +934,21 @@ void YM2612::ShiftOctaveDown()
   Serial.print("Octave Shift Down: "); Serial.print(octaveShift);
 }
 
-uint16_t YM2612::CalcFNumber(float note)
-{
-  const uint32_t clockFrq = 8000000;
-  return (144*note*(pow(2, 20))/clockFrq) / pow(2, 4-1);
-}
 
 //DRY OMEGALUL
 void YM2612::SetTL(uint8_t slot, uint8_t op, uint8_t value)
 {
-  bool a1 = (slot > 2); 
-  slot %= 3;
-  uint8_t addr = (0x40 + (0x04*op))+slot;
-  send(addr, value, a1);
+  if(value > 0x7F)
+    value = 0x7F;
+  slotVoice[slot].OP[op][IMG_TL] = value; //Velocity scaling works from the patch TL
+  WriteChannelTL(slot);
 }
 
 void YM2612::SetAR(uint8_t slot, uint8_t op, uint8_t value)
 {
   if(value > 0x1F)
     value = 0x1F;
+  SetImageField(slotVoice[slot].OP[op][IMG_RSAR], 0x1F, 0, value);
   bool a1 = (slot > 2); 
   slot %= 3;
   uint8_t addr = (0x50 + (0x04*op))+slot;
@@ -612,6 +963,7 @@ void YM2612::SetD1R(uint8_t slot, uint8_t op, uint8_t value)
 {
   if(value > 0x1F)
     value = 0x1F;
+  SetImageField(slotVoice[slot].OP[op][IMG_AMD1R], 0x1F, 0, value);
   bool a1 = (slot > 2); 
   slot %= 3;
   uint8_t addr = (0x60 + (0x04*op))+slot;
@@ -626,6 +978,7 @@ void YM2612::SetD1L(uint8_t slot, uint8_t op, uint8_t value)
 {
   if(value > 0x0F)
     value = 0x0F;
+  SetImageField(slotVoice[slot].OP[op][IMG_D1LRR], 0x0F, 4, value);
   bool a1 = (slot > 2); 
   slot %= 3;
   uint8_t addr = (0x80 + (0x04*op))+slot;
@@ -638,6 +991,7 @@ void YM2612::SetD1L(uint8_t slot, uint8_t op, uint8_t value)
 
 void YM2612::SetD2R(uint8_t slot, uint8_t op, uint8_t value)
 {
+  slotVoice[slot].OP[op][IMG_D2R] = value;
   bool a1 = (slot > 2); 
   slot %= 3;
   uint8_t addr = (0x70 + (0x04*op))+slot;
@@ -648,6 +1002,7 @@ void YM2612::SetRR(uint8_t slot, uint8_t op, uint8_t value)
 {
   if(value > 0x0F)
     value = 0x0F;
+  SetImageField(slotVoice[slot].OP[op][IMG_D1LRR], 0x0F, 0, value);
   bool a1 = (slot > 2); 
   slot %= 3;
   uint8_t addr = (0x80 + (0x04*op))+slot;
@@ -662,6 +1017,7 @@ void YM2612::SetDetune(uint8_t slot, uint8_t op, uint8_t value)
 {
   if(value > 0x07)
     value = 0x07;
+  SetImageField(slotVoice[slot].OP[op][IMG_DT1MUL], 0x07, 4, value);
   bool a1 = (slot > 2); 
   slot %= 3;
   uint8_t addr = (0x30 + (0x04*op))+slot;
@@ -676,6 +1032,7 @@ void YM2612::SetMult(uint8_t slot, uint8_t op, uint8_t value)
 {
   if(value > 0x0F)
     value = 0x0F;
+  SetImageField(slotVoice[slot].OP[op][IMG_DT1MUL], 0x0F, 0, value);
   bool a1 = (slot > 2); 
   slot %= 3;
   uint8_t addr = (0x30 + (0x04*op))+slot;
@@ -690,6 +1047,7 @@ void YM2612::SetRateScaling(uint8_t slot, uint8_t op, uint8_t value)
 {
   if(value > 0x03)
     value = 0x03;
+  SetImageField(slotVoice[slot].OP[op][IMG_RSAR], 0x03, 6, value);
   bool a1 = (slot > 2); 
   slot %= 3;
   uint8_t addr = (0x50 + (0x04*op))+slot;
@@ -702,6 +1060,7 @@ void YM2612::SetRateScaling(uint8_t slot, uint8_t op, uint8_t value)
 
 void YM2612::SetAmplitudeModulation(uint8_t slot, uint8_t op, bool value)
 {
+  SetImageField(slotVoice[slot].OP[op][IMG_AMD1R], 0x01, 7, value);
   bool a1 = (slot > 2); 
   slot %= 3;
   uint8_t addr = (0x60 + (0x04*op))+slot;
@@ -709,7 +1068,43 @@ void YM2612::SetAmplitudeModulation(uint8_t slot, uint8_t op, bool value)
 
   data &= 0b01111111; //Mask AR
   data |= value << 7;
-  send(addr, data, a1);
+  send(addr, LFOOverride(addr, data), a1);
+}
+
+//While the LFO is on, ToggleLFO() forces AM on every operator and its own AMS/FMS on every channel.
+//Edits still land in slotVoice and come back when the LFO is turned off
+uint8_t YM2612::LFOOverride(uint8_t addr, uint8_t data)
+{
+  if(!lfoOn)
+    return data;
+  if((addr & 0xF0) == 0x60)
+    return data | (1 << 7);
+  if(addr >= 0xB4 && addr <= 0xB6)
+    return 0xC0 + (3 << 4) + lfoSens;
+  return data;
+}
+
+//Change one packed field on every channel at once. field is the byte offset into VoiceImage, addr the channel 0 register.
+//The six read-modify-writes go out back to back so the queue drains them as one batch
+void YM2612::SetVoiceField(uint8_t field, uint8_t addr, uint8_t mask, uint8_t shift, uint8_t value)
+{
+  if(value > mask)
+    value = mask;
+  for(uint8_t ch = 0; ch<MAX_CHANNELS_YM; ch++)
+    SetImageField(((unsigned char *)&slotVoice[ch])[field], mask, shift, value); //Velocity scaling works from the patch TL and algorithm
+  bool tl = (addr & 0xF0) == 0x40; //The shadow TL includes velocity, rebuild it from the patch instead
+  uint8_t clear = ~(mask << shift);
+  uint8_t set = value << shift;
+  for(int a1 = 0; a1<=1; a1++)
+  {
+    for(int i=0; i<3; i++)
+    {
+      if(!tl)
+        send(addr + i, LFOOverride(addr, (GetShadowValue(addr + i, a1) & clear) | set), a1);
+      if(tl || addr == 0xB0)
+        WriteChannelTL(i + a1*3);
+    }
+  }
 }
 
 void YM2612::SetLFOEnabled(bool value)
@@ -732,6 +1127,7 @@ void YM2612::SetFreqModSens(uint8_t slot, uint8_t value)
 {
   if(value > 0x07)
     value = 0x07;
+  SetImageField(slotVoice[slot].LRAMSFMS, 0x07, 0, value);
   bool a1 = (slot > 2); 
   slot %= 3;
   uint8_t addr = 0xB4 + slot;
@@ -739,28 +1135,31 @@ void YM2612::SetFreqModSens(uint8_t slot, uint8_t value)
 
   data &= 0b11111000; //Mask L_R_AMS
   data |= value;
-  send(addr, data, a1);
+  send(addr, LFOOverride(addr, data), a1);
 }
 
 void YM2612::SetAMSens(uint8_t slot, uint8_t value)
 {
-  if(value > 0x07)
-    value = 0x07;
+  if(value > 0x03)
+    value = 0x03;
+  SetImageField(slotVoice[slot].LRAMSFMS, 0x03, 4, value);
+  slotVoice[slot].LRAMSFMS |= 0b11000000;
   bool a1 = (slot > 2); 
   slot %= 3;
   uint8_t addr = 0xB4 + slot;
   uint8_t data = GetShadowValue(addr, a1);
 
-  data &= 0b11000111; //Mask L_R_FMS
-  data |= value << 3;
+  data &= 0b11001111; //Mask L_R_FMS
+  data |= value << 4;
   data |= 0b11000000; //Set L_R to true for now
-  send(addr, data, a1);
+  send(addr, LFOOverride(addr, data), a1);
 }
 
 void YM2612::SetAlgo(uint8_t slot, uint8_t value)
 {
   if(value > 0x07)
     value = 0x07;
+  SetImageField(slotVoice[slot].FBALGO, 0x07, 0, value); //Velocity scaling needs to know the carriers
   bool a1 = (slot > 2); 
   slot %= 3;
   uint8_t addr = 0xB0 + slot;
@@ -769,12 +1168,14 @@ void YM2612::SetAlgo(uint8_t slot, uint8_t value)
   data &= 0b11111000; //Mask feedback
   data |= value;
   send(addr, data, a1);
+  WriteChannelTL(slot + a1*3); //Carriers changed, move the velocity attenuation with them
 }
 
 void YM2612::SetFMFeedback(uint8_t slot, uint8_t value)
 {
   if(value > 0x07)
     value = 0x07;
+  SetImageField(slotVoice[slot].FBALGO, 0x07, 3, value);
   bool a1 = (slot > 2); 
   slot %= 3;
   uint8_t addr = 0xB0 + slot;
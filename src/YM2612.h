@@ -6,6 +6,14 @@
 
 #define mask(s) (~(~0<<s))
 const int MAX_CHANNELS_YM = 6;
+const uint8_t YM_NO_CHANNEL = 0xFF;
+const uint8_t YM_OCTAVES = 11; //Rows in the F-number table
+const uint8_t YM_KEYS = 128; //noteMap size, higher keys are folded down an octave
+const uint8_t YM_QUEUE_SIZE = 128; //Register write queue length. Must be a power of two
+const uint8_t YM_QUEUE_TICK = 32;  //uS between Timer2 drains, one write each. Must outlast YM_DATA_DELAY
+const uint8_t YM_ADDR_DELAY = 2;   //uS between address and data write (17 YM clocks)
+const uint8_t YM_DATA_DELAY = 11;  //uS busy period after a data write (83 YM clocks) when not polling
+const uint16_t YM_BUSY_TIMEOUT = 512; //Status polls before giving up on the busy flag
 
 class YM2612
 {
@@ -23,15 +31,65 @@ private:
         bool sustained = false;
         uint8_t keyNumber = 0;
         uint8_t blockNumber = 0;
-        uint8_t index = 0;
+        uint32_t releasedAt = 0; //millis() at key off, released channels keep bending for a while
+        int16_t pitchBend = 0;
+        uint8_t attenuation = 0; //Velocity, added to the carrier TLs whenever they are written
+        bool fixed = false; //Played by its own MIDI channel (YM_VST_1..YM_VST_6). Off both lists while keyed on, never stolen
+        uint8_t prev = YM_NO_CHANNEL; //Links in the free or active list
+        uint8_t next = YM_NO_CHANNEL;
     } Channel;
     uint8_t lfoFrq = 0;
     uint8_t lfoSens = 7;
     int8_t octaveShift = 0;
     unsigned char bank0[0xB7-0x21]; //Shadow registers
     unsigned char bank1[0xB7-0x30];
-    Voice currentVoice;
+    VoiceImage slotVoice[MAX_CHANNELS_YM]; //Patch each channel is playing, without velocity or the LFO's forced AM
+    uint8_t bendPending = 0; //Bit per channel
+    uint8_t noteMap[YM_KEYS]; //Key -> keyed on channel
+    uint8_t freeHead, freeTail; //Released channels, longest released first
+    uint8_t activeHead, activeTail; //Keyed on channels, oldest note first
+    void ListRemove(uint8_t &head, uint8_t &tail, uint8_t ch);
+    void ListAppend(uint8_t &head, uint8_t &tail, uint8_t ch);
+    void ResetChannels();
+    static uint8_t FoldKey(uint8_t key);
+    void KeyOnChannel(uint8_t channel, uint8_t key, uint8_t velocity, bool velocityEnabled);
+    void ReleaseChannel(uint8_t channel);
+    uint16_t ChannelFrequency(uint8_t channel);
+    uint8_t ChannelTL(uint8_t channel, uint8_t op);
+    void WriteChannelTL(uint8_t channel);
+    uint8_t LFOOverride(uint8_t addr, uint8_t data);
+    typedef struct
+    {
+        uint8_t addr;
+        uint8_t data;
+        bool setA1;
+        bool latencyStamp; //Key-on with a NoteLatency stamp waiting for it
+    } QueuedWrite;
+    QueuedWrite writeQueue[YM_QUEUE_SIZE]; //Filled by send(), emptied by the Timer2 ISR
+    volatile uint8_t queueHead = 0;
+    volatile uint8_t queueTail = 0;
+    volatile bool drainUnsettled = false; //The ISR wrote last and did not wait out the busy period
+    bool shadowValid = false; //Shadow matches the chip once it has been through Reset()
+    uint32_t writesIssued = 0;
+    uint32_t writesElided = 0;
+    bool IsTriggerRegister(uint8_t addr);
+    bool busyPolling = false; //Poll the status register on /RD instead of relying on fixed delays
+    uint32_t busyWaits = 0;
+    uint32_t busyPolls = 0;
+    uint16_t busyPollsMax = 0;
+    uint32_t busyTimeouts = 0;
+    bool WaitWhileBusy();
+    void WriteNext(bool settle);
+    void SettleAfterDrain();
+    void WriteVoiceSlot(uint8_t slot, const VoiceImage &v, uint8_t lfoAM, uint8_t lrAmsFms);
+    void write(unsigned char addr, unsigned char data, bool setA1, bool settle=true);
+    void writePinByPin(unsigned char addr, unsigned char data, bool setA1);
 public:
+    typedef struct
+    {
+        unsigned char bank0[0xB7-0x21];
+        unsigned char bank1[0xB7-0x30];
+    } RegisterSnapshot;
     YM2612();
     Channel channels[MAX_CHANNELS_YM];
     bool lfoOn = false;
@@ -39,20 +97,36 @@ public:
     void SetOctaveShift(int8_t shift);
     void SetChannelOn(uint8_t key, uint8_t velocity, bool velocityEnabled);
     void SetChannelOff(uint8_t key);
-    void SetVoice(Voice v);
-    float NoteToFrequency(uint8_t note);
+    void SetFixedChannelOn(uint8_t channel, uint8_t key, uint8_t velocity);
+    void SetFixedChannelOff(uint8_t channel, uint8_t key);
+    void SetChannelVelocity(uint8_t channel, uint8_t velocity);
+    void SetVoice(VoiceImage v, bool delta=false);
+    uint16_t NoteToFrequency(int16_t note);
+    uint16_t BendFrequency(uint8_t key, int pitch);
     void SetFrequency(uint16_t frequency, uint8_t channel);
     void AdjustLFO(uint8_t value);
     void AdjustPitch(uint8_t channel, int pitch);
+    void SetPitchBend(int pitch);
+    void UpdatePitchBend();
     void ReleaseSustainedKeys();
     void ClampSustainedKeys();
-    uint16_t CalcFNumber(float note);
     void ShiftOctaveUp();
     void ShiftOctaveDown();
     void ToggleLFO();
     void Reset();
-    void send(unsigned char addr, unsigned char data, bool setA1=0);
+    void send(unsigned char addr, unsigned char data, bool setA1=0, bool latencyStamp=false);
+    void Flush();
+    uint8_t Pending();
+    void DrainWriteQueue();
     void DumpShadowRegisters();
+    void Snapshot(RegisterSnapshot &snap);
+    void Restore(const RegisterSnapshot &snap, bool rekeyHeldNotes);
+    void DumpWriteStats();
+    void SetBusyPolling(bool enabled);
+    bool GetBusyPolling();
+    void CalibrateBusy();
+    void BenchmarkBus();
+    uint32_t GetWritesIssued();
     uint8_t GetShadowValue(uint8_t addr, bool bank);
 
     //Manual register setting for MIDI exposure
@@ -66,7 +140,9 @@ public:
     void SetMult(uint8_t slot, uint8_t op, uint8_t value);
     void SetRateScaling(uint8_t slot, uint8_t op, uint8_t value);
     void SetAmplitudeModulation(uint8_t slot, uint8_t op, bool value);
-    void SetVoiceManual(uint8_t slot, Voice v);
+    void SetVoiceManual(uint8_t slot, VoiceImage v);
+    VoiceImage GetSlotImage(uint8_t slot);
+    void SetVoiceField(uint8_t field, uint8_t addr, uint8_t mask, uint8_t shift, uint8_t value);
     
     //Globals
     void SetLFOEnabled(bool value);
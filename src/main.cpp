@@ -57,11 +57,19 @@ avrdude -c arduino -p usb1286 -P COM16 -b 19200 -U flash:w:"LOCATION_OF_YOUR_PRO
 #include "Voice.h"
 #include "YM2612.h"
 #include "SN76489.h"
+#include "NoteLatency.h"
+#include "MidiUart.h"
+#include "MidiEvents.h"
+#include "Scheduler.h"
+#include "PatchDump.h"
+#include "LCDFrameBuffer.h"
+#include "DataBus.h"
 #include "SdFat.h"
 #include <MIDI.h>
 #include <Encoder.h>
 #include <LiquidCrystal.h>
 #include <EEPROM.h>
+#include <avr/eeprom.h>
 #include "LCDChars.h"
 #include "NPRM.h"
 
@@ -82,11 +90,17 @@ avrdude -c arduino -p usb1286 -P COM16 -b 19200 -U flash:w:"LOCATION_OF_YOUR_PRO
 #define YM_VST_4 14
 #define YM_VST_5 15
 #define YM_VST_6 16
-uint8_t sendPatchToVST = 0xFF;
 
 NPRM nprm;
+NPRM nprmInput; //Assembled from CC 99/98/6/38 as they arrive, queued once complete
 
-MIDI_CREATE_INSTANCE(HardwareSerial, Serial1, MIDI);
+//The MIDI library silently drops SysEx longer than its buffer. A full OPM block is 60 bytes with F0/F7
+struct DinMidiSettings : public midi::DefaultSettings
+{
+  static const unsigned SysExMaxSize = 128;
+};
+static_assert(DinMidiSettings::SysExMaxSize >= 60, "DIN SysEx buffer cannot hold an OPM block");
+MIDI_CREATE_CUSTOM_INSTANCE(MidiUart, midiUart, MIDI, DinMidiSettings); //DIN input goes through our own RX ring buffer instead of Serial1
 
 //DEBUG
 #define DLED 8
@@ -100,12 +114,11 @@ Encoder encoder(18, 19);
 long encoderPos = 0;
 
 //LCD
-#define LCD_ROWS 4
-#define LCD_COLS 20
 uint16_t fileNameScrollIndex = 0;
 String fileScroll;
 uint8_t lcdSelectionIndex = 0;
-LiquidCrystal lcd(17, 26, 38, 39, 40, 41, 42, 43, 44, 45); //PC7 & PB6 + Same data bus as sound chips
+LiquidCrystal lcdDevice(17, 26, 38, 39, 40, 41, 42, 43, 44, 45); //PC7 & PB6 + Same data bus as sound chips
+LCDFrameBuffer lcd(lcdDevice); //Everything prints here, TaskLCD sends the changes to lcdDevice
 bool redrawLCDOnNextLoop = false;
 bool stopLCDFileUpdate = false;
 
@@ -126,12 +139,30 @@ File file;
 #define PREV_FILE 0x02
 #define MAX_FILE_NAME_SIZE 128
 char fileName[MAX_FILE_NAME_SIZE];
+bool vstModeActive = false; //fileName holds "VST", saves a strcmp on every NRPN and SysEx
 uint32_t numberOfFiles = 0;
 uint32_t currentFileNumber = 0;
 bool isFileValid = false;
 
 //Favorites
 uint8_t currentFavorite = 0xFF; //If favorite = 0xFF, go back to SD card voices
+#define FAVORITE_HOLD_MS 2000 //Hold a favorite button this long to save the current voice to it
+#define FAVORITE_DEBOUNCE_MS 50
+enum FavoriteButtonState
+{
+  FAV_IDLE, FAV_HELD, FAV_WAIT_RELEASE, FAV_DEBOUNCE
+};
+FavoriteButtonState favoriteState = FAV_IDLE;
+byte favoriteButtons = 0;
+uint8_t favoritePrevious = 0xFF;
+uint32_t favoriteChangedAt = 0;
+uint8_t favoriteBlinkLED = 0xFF;
+uint32_t favoriteBlinkStart = 0;
+FavoriteVoice favoritePending; //Written to EEPROM a byte at a time from loop()
+uint16_t favoritePendingAddress = 0;
+uint8_t favoritePendingWritten = sizeof(FavoriteVoice); //== sizeof(FavoriteVoice) when nothing is pending
+FavoriteVoice favoriteQueued; //Saved to another favorite while favoritePending was still being written, goes next
+bool favoriteQueuedValid = false;
 
 //Prototypes
 void KeyOn(byte channel, byte key, byte velocity);
@@ -140,17 +171,21 @@ void ProgramChange(byte channel, byte program);
 void PitchChange(byte channel, int pitch);
 void ControlChange(byte channel, byte control, byte value);
 void SystemExclusive(byte *data, uint16_t length);
-void HandleFavoriteButtons(byte portValue);
+void DinSystemExclusive(byte *data, unsigned length);
+void HandleFavoriteButtons();
+void UpdateFavoriteBlink(uint32_t now);
+bool UpdateFavoriteWrite();
+const FavoriteVoice *PendingFavorite(uint8_t index);
 bool LoadFile(byte strategy);
 void BlinkLED(byte led);
 void ClearLCDLine(byte line);
 bool LoadFile(String req);
-void PutFavoriteIntoEEPROM(Voice v, uint16_t index);
-void SetVoice(Voice v);
+bool PutFavoriteIntoEEPROM(VoiceImage v, uint16_t index);
+void SetVoice(VoiceImage v);
 void removeMeta();
 void ReadVoiceData();
 void HandleSerialIn();
-void DumpVoiceData(Voice v);
+void DumpVoiceData(VoiceImage img);
 void ResetSoundChips();
 void HandleRotaryButtonDown();
 void HandleRotaryEncoder();
@@ -161,9 +196,24 @@ void UpdateLEDs();
 void ProgramNewFavorite();
 void SDReadFailure();
 void HandleNPRM(uint8_t channel);
-void SendPatchSysex(uint8_t slot);
+bool GetDumpVoice(uint8_t item, Voice &v);
 void VSTMode();
-Voice GetFavoriteFromEEPROM(uint16_t index);
+VoiceImage GetFavoriteFromEEPROM(uint16_t index);
+void OnNoteOn(byte channel, byte key, byte velocity);
+void OnNoteOff(byte channel, byte key, byte velocity);
+void OnProgramChange(byte channel, byte program);
+void OnPitchChange(byte channel, int pitch);
+void OnControlChange(byte channel, byte control, byte value);
+void DispatchMidiEvent(const MidiEvent &e);
+void ProcessMidiEvents();
+void TaskMidiInput();
+void TaskMidiApply();
+void TaskButtons();
+void TaskLCD();
+bool UsbMidiPending();
+bool LCDShouldYield();
+void TaskSerial();
+void TaskVSTPatch();
 
 void setup() 
 {
@@ -183,10 +233,10 @@ void setup()
   OCR3A =  1; //Divide by 4
 
   Serial.begin(115200);
-  lcd.createChar(0, arrowCharLeft);
-  lcd.createChar(1, arrowCharRight);
-  lcd.createChar(2, heartChar);
-  lcd.begin(LCD_COLS, LCD_ROWS);
+  lcdDevice.createChar(0, arrowCharLeft);
+  lcdDevice.createChar(1, arrowCharRight);
+  lcdDevice.createChar(2, heartChar);
+  lcdDevice.begin(LCD_COLS, LCD_ROWS);
 
   lcd.print("     Welcome To");
   lcd.setCursor(0,1);
@@ -196,6 +246,7 @@ void setup()
   lcd.setCursor(0,3);
   lcd.print("        2019  ");
   lcd.print(FW_VERSION);
+  lcd.Flush();
 
   MIDI.begin(MIDI_CHANNEL_OMNI);
 
@@ -203,18 +254,19 @@ void setup()
   sn76489.Reset();
   ym2612.Reset();
 
-  usbMIDI.setHandleNoteOn(KeyOn);
-  usbMIDI.setHandleNoteOff(KeyOff);
-  usbMIDI.setHandleProgramChange(ProgramChange);
-  usbMIDI.setHandlePitchChange(PitchChange);
-  usbMIDI.setHandleControlChange(ControlChange);
+  usbMIDI.setHandleNoteOn(OnNoteOn);
+  usbMIDI.setHandleNoteOff(OnNoteOff);
+  usbMIDI.setHandleProgramChange(OnProgramChange);
+  usbMIDI.setHandlePitchChange(OnPitchChange);
+  usbMIDI.setHandleControlChange(OnControlChange);
   usbMIDI.setHandleSystemExclusive(SystemExclusive);
 
-  MIDI.setHandleNoteOn(KeyOn);
-  MIDI.setHandleNoteOff(KeyOff);
-  MIDI.setHandleProgramChange(ProgramChange);
-  MIDI.setHandlePitchBend(PitchChange);
-  MIDI.setHandleControlChange(ControlChange);
+  MIDI.setHandleNoteOn(OnNoteOn);
+  MIDI.setHandleNoteOff(OnNoteOff);
+  MIDI.setHandleProgramChange(OnProgramChange);
+  MIDI.setHandlePitchBend(OnPitchChange);
+  MIDI.setHandleControlChange(OnControlChange);
+  MIDI.setHandleSystemExclusive(DinSystemExclusive);
 
   pinMode(DLED, OUTPUT);
   pinMode(PROG_UP, INPUT_PULLUP);
@@ -223,8 +275,7 @@ void setup()
   pinMode(ENC_BTN, INPUT_PULLUP);
   pinMode(PSG_READY, INPUT);
 
-  MIDI.turnThruOff();
-  UCSR1B &= ~(1UL << 3); //Release the Hardware Serial1 TX pin from USART transmitter.
+  MIDI.turnThruOff(); //MidiUart never enables the USART transmitter, the TX pin stays free for its LED
 
   DDRA = 0x00;
   PORTA = 0xFF;
@@ -247,28 +298,87 @@ void setup()
   ym2612.SetVoice(voices[0]);
   DumpVoiceData(voices[0]);
   LCDRedraw();
+
+  patchDump.SetSource(GetDumpVoice);
+  scheduler.Add("MIDI in", TaskMidiInput, TASK_CRITICAL, 500);
+  scheduler.Add("MIDI apply", TaskMidiApply, TASK_CRITICAL, 1000);
+  scheduler.Add("Buttons", TaskButtons, TASK_HIGH, 500);
+  scheduler.Add("LCD", TaskLCD, TASK_NORMAL, 2000);
+  scheduler.Add("VST patch", TaskVSTPatch, TASK_NORMAL, 2000);
+  scheduler.Add("Serial", TaskSerial, TASK_LOW, 2000);
 }
 
-void PutFavoriteIntoEEPROM(Voice v, uint16_t index)
+//Never waits on the EEPROM. One save can queue behind the one being written, false if both are taken
+bool PutFavoriteIntoEEPROM(VoiceImage v, uint16_t index)
 {
   if(index > 7)
-    return;
+    return false;
   FavoriteVoice fv;
-  fv.v = v;
+  DecompileVoice(v, fv.v); //Favorites stay in OPM format so existing EEPROM contents remain valid
   fv.index = index;
   strncpy(fv.fileName, fileName, 20);
   fv.fileName[20] = '\0';
   fv.voiceNumber = currentProgram;
   fv.octaveShift = ym2612.GetOctaveShift();
-  EEPROM.put(sizeof(FavoriteVoice)*index, fv);
+  if(favoritePendingWritten == sizeof(FavoriteVoice) || favoritePending.index == index)
+  {
+    //Same favorite again starts over, EEPROM.update() skips the bytes that already made it
+    favoritePending = fv;
+    favoritePendingAddress = sizeof(FavoriteVoice)*index;
+    favoritePendingWritten = 0;
+    return true;
+  }
+  if(favoriteQueuedValid && favoriteQueued.index != index)
+    return false;
+  favoriteQueued = fv;
+  favoriteQueuedValid = true;
+  return true;
+}
+//Each EEPROM byte takes ~3.4mS to program. Start the next one only when the last has finished so this never waits.
+//Returns true on the call that completes the favorite
+bool UpdateFavoriteWrite()
+{
+  if(favoritePendingWritten == sizeof(FavoriteVoice))
+    return false;
+  const uint8_t *data = (const uint8_t *)&favoritePending;
+  while(favoritePendingWritten < sizeof(FavoriteVoice) && eeprom_is_ready())
+  {
+    EEPROM.update(favoritePendingAddress + favoritePendingWritten, data[favoritePendingWritten]); //Unchanged bytes are skipped
+    favoritePendingWritten++;
+  }
+  if(favoritePendingWritten < sizeof(FavoriteVoice))
+    return false;
+  if(favoriteQueuedValid)
+  {
+    favoritePending = favoriteQueued;
+    favoritePendingAddress = sizeof(FavoriteVoice)*favoritePending.index;
+    favoritePendingWritten = 0;
+    favoriteQueuedValid = false;
+  }
+  LCDRedraw(lcdSelectionIndex);
+  return true;
+}
+//Newest copy of a favorite that has not fully reached the EEPROM yet, NULL if there is none
+const FavoriteVoice *PendingFavorite(uint8_t index)
+{
+  if(favoriteQueuedValid && favoriteQueued.index == index)
+    return &favoriteQueued;
+  if(favoritePendingWritten < sizeof(FavoriteVoice) && favoritePending.index == index)
+    return &favoritePending;
+  return NULL;
 }
 
-Voice GetFavoriteFromEEPROM(uint16_t index)
+VoiceImage GetFavoriteFromEEPROM(uint16_t index)
 {
   if(index >= 8)
     return voices[currentProgram];
+  //A favorite still being written comes from RAM, the others are not touched by the write
   FavoriteVoice fv;
-  EEPROM.get(sizeof(FavoriteVoice)*index, fv);
+  const FavoriteVoice *pending = PendingFavorite(index);
+  if(pending)
+    fv = *pending;
+  else
+    EEPROM.get(sizeof(FavoriteVoice)*index, fv);
   if(fv.index != index)
   {
     Serial.println("ERROR, index mismatch!");
@@ -284,7 +394,9 @@ Voice GetFavoriteFromEEPROM(uint16_t index)
   }
   ym2612.SetOctaveShift(fv.octaveShift);
   LCDRedraw(lcdSelectionIndex);
-  return fv.v;
+  VoiceImage img;
+  CompileVoice(fv.v, img);
+  return img;
 }
 
 void IntroLEDs()
@@ -307,6 +419,7 @@ bool LoadFile(byte strategy) //Request a file with NEXT, PREV, FIRST commands
 {
   File nextFile;
   memset(fileName, 0x00, MAX_FILE_NAME_SIZE);
+  vstModeActive = false;
   switch(strategy)
   {
     case FIRST_FILE:
@@ -399,6 +512,7 @@ void SDReadFailure()
   lcd.print("SD card");
   lcd.setCursor(0,1);
   lcd.print("read failure!");
+  lcd.Flush();
   for(int i = 0; i<8; i++)
   {
     if(i%2==0)
@@ -439,6 +553,7 @@ bool LoadFile(String req) //Request a file (string) to load
   }
   memset(fileName, 0x00, MAX_FILE_NAME_SIZE);
   strncpy(fileName, searchFn, MAX_FILE_NAME_SIZE);
+  vstModeActive = false;
   if(file.isOpen())
     file.close();
   file = SD.open(fileName, FILE_READ);
@@ -539,8 +654,13 @@ void LCDRedraw(uint8_t graphicCursorPos)
 
   if(currentFavorite != 0xFF && currentFavorite < 8)
   {
+    //A favorite still being written is shown from RAM, UpdateFavoriteWrite() finishes it in the background
     FavoriteVoice fv;
-    EEPROM.get(sizeof(FavoriteVoice)*currentFavorite, fv);
+    const FavoriteVoice *pending = PendingFavorite(currentFavorite);
+    if(pending)
+      fv = *pending;
+    else
+      EEPROM.get(sizeof(FavoriteVoice)*currentFavorite, fv);
     lcd.setCursor(0, 2);
     lcd.print(fv.fileName);
     lcd.setCursor(0, 3);
@@ -550,9 +670,11 @@ void LCDRedraw(uint8_t graphicCursorPos)
 
 void ResetSoundChips()
 {
+  static YM2612::RegisterSnapshot snap;
+  ym2612.Snapshot(snap);
   ym2612.Reset();
   sn76489.Reset();
-  ym2612.SetVoice(voices[currentProgram]);
+  ym2612.Restore(snap, false); //Patch, LFO and pitch survive, sounding notes do not
   Serial.println("Soundchips Reset");
 }
 
@@ -598,18 +720,20 @@ void ReadVoiceData()
           }
         }
 
+        Voice v;
         for(int i=0; i<5; i++) //LFO
-          voices[voiceCount].LFO[i] = vDataRaw[0][i];
+          v.LFO[i] = vDataRaw[0][i];
         for(int i=0; i<7; i++) //CH
-          voices[voiceCount].CH[i] = vDataRaw[1][i];
+          v.CH[i] = vDataRaw[1][i];
         for(int i=0; i<11; i++) //M1
-          voices[voiceCount].M1[i] = vDataRaw[2][i];
+          v.M1[i] = vDataRaw[2][i];
         for(int i=0; i<11; i++) //C1
-          voices[voiceCount].C1[i] = vDataRaw[3][i];
+          v.C1[i] = vDataRaw[3][i];
         for(int i=0; i<11; i++) //M2
-          voices[voiceCount].M2[i] = vDataRaw[4][i];
+          v.M2[i] = vDataRaw[4][i];
         for(int i=0; i<11; i++) //C2
-          voices[voiceCount].C2[i] = vDataRaw[5][i];
+          v.C2[i] = vDataRaw[5][i];
+        CompileVoice(v, voices[voiceCount]); //Only the register image is kept in RAM
         voiceCount++;
       }
       if(voiceCount == MAX_VOICES-1)
@@ -629,8 +753,10 @@ void ReadVoiceData()
   }
 }
 
-void DumpVoiceData(Voice v) //Used to check operator settings from loaded OPM file
+void DumpVoiceData(VoiceImage img) //Used to check operator settings from loaded OPM file
 {
+  Voice v;
+  DecompileVoice(img, v);
   Serial.print("LFO: ");
   for(int i = 0; i<5; i++)
   {
@@ -673,17 +799,12 @@ void PitchChange(byte channel, int pitch)
 {
   if(channel == YM_CHANNEL || channel == YM_VELOCITY_CHANNEL || channel == YM_VST_ALL)
   {
-    pitchBendYM = pitch;
-    for(int i = 0; i<MAX_CHANNELS_YM; i++)
-    {
-      ym2612.AdjustPitch(i, pitch);
-    }
+    ym2612.SetPitchBend(pitch);
+  }
+  else if(channel >= YM_VST_1 && channel <= YM_VST_6)
+  {
+    ym2612.AdjustPitch(channel-YM_VST_1, pitch);
   }
-  // else if(channel > YM_VST_ALL && channel <= YM_VST_6)
-  // {
-  //   pitchBendYM = pitch;
-  //   ym2612.AdjustPitch(channel-11, pitch);
-  // }
   else if(channel == PSG_CHANNEL || channel == PSG_VELOCITY_CHANNEL)
   {
     for(int i = 0; i<MAX_CHANNELS_PSG; i++)
@@ -693,7 +814,6 @@ void PitchChange(byte channel, int pitch)
   }
 }
 
-bool ymVelocityEnabledFlag = false;
 void KeyOn(byte channel, byte key, byte velocity)
 {
   stopLCDFileUpdate = true;
@@ -701,16 +821,14 @@ void KeyOn(byte channel, byte key, byte velocity)
   {
     if(isFileValid || currentFavorite != 0xFF)
     {
-      if(channel == YM_VELOCITY_CHANNEL)
-        ymVelocityEnabledFlag = true;
-      else if(ymVelocityEnabledFlag)
-      {
-        ymVelocityEnabledFlag = false;
-        ym2612.SetVoice(voices[currentProgram]);
-      }
-      ym2612.SetChannelOn(key+SEMITONE_ADJ_YM, velocity, ymVelocityEnabledFlag);
+      //Velocity only touches the allocated channel's carriers, so no patch reload is needed when switching back
+      ym2612.SetChannelOn(key+SEMITONE_ADJ_YM, velocity, channel == YM_VELOCITY_CHANNEL);
     }
   }
+  else if(channel >= YM_VST_1 && channel <= YM_VST_6)
+  {
+    ym2612.SetFixedChannelOn(channel-YM_VST_1, key+SEMITONE_ADJ_YM, velocity);
+  }
   else if(channel == PSG_CHANNEL || channel == PSG_VELOCITY_CHANNEL)
   {
     sn76489.SetChannelOn(key+SEMITONE_ADJ_PSG, velocity, channel == PSG_VELOCITY_CHANNEL);
@@ -727,6 +845,10 @@ void KeyOff(byte channel, byte key, byte velocity)
   {
     ym2612.SetChannelOff(key+SEMITONE_ADJ_YM);
   }
+  else if(channel >= YM_VST_1 && channel <= YM_VST_6)
+  {
+    ym2612.SetFixedChannelOff(channel-YM_VST_1, key+SEMITONE_ADJ_YM);
+  }
   else if(channel == PSG_CHANNEL || channel == PSG_VELOCITY_CHANNEL)
   {
     sn76489.SetChannelOff(key+SEMITONE_ADJ_PSG);
@@ -761,73 +883,265 @@ void ControlChange(byte channel, byte control, byte value)
       PSGsustainEnabled == true ? sn76489.ClampSustainedKeys() : sn76489.ReleaseSustainedKeys();
     }
   }
-  else
+}
+
+//MIDI input handlers (USB and DIN). These only queue, ProcessMidiEvents() applies them from loop()
+void QueueOrderedEvent(uint8_t type, byte channel, uint16_t param, int16_t value)
+{
+  MidiEvent e = {type, channel, param, value, micros()};
+  if(!midiEvents.Push(e))
   {
-    switch (control) //NRPN to control synth manually
-    {
-      case 99:
-      nprm.parameter = value << 7;
-      break;
-      case 98:
-      nprm.parameter += value;
-      break;
-      case 6:
-      nprm.value = value << 7;
-      break;
-      case 38:
-      nprm.value = nprm.value + value;
+    ProcessMidiEvents(); //Full, catch up first so nothing is reordered
+    midiEvents.Push(e);
+  }
+}
 
-      //Handle NPRM
-      //Serial.print("NPRM --- "); Serial.print("PARAM: "); Serial.print(nprm.parameter); Serial.print("   "); Serial.print("VALUE: "); Serial.println(nprm.value);
+void QueueLatestEvent(uint8_t type, byte channel, uint16_t param, int16_t value)
+{
+  MidiEvent e = {type, channel, param, value, micros()};
+  if(!midiEvents.Coalesce(e))
+  {
+    ProcessMidiEvents(); //Every slot taken, apply the queue first so notes before this event keep their place
+    midiEvents.Coalesce(e);
+  }
+}
 
-      HandleNPRM(channel);
-      break;
-      default:
-      return;
-    }
+void OnNoteOn(byte channel, byte key, byte velocity)
+{
+  QueueOrderedEvent(MIDI_EVENT_NOTE_ON, channel, key, velocity);
+}
+
+void OnNoteOff(byte channel, byte key, byte velocity)
+{
+  QueueOrderedEvent(MIDI_EVENT_NOTE_OFF, channel, key, velocity);
+}
+
+void OnProgramChange(byte channel, byte program)
+{
+  QueueOrderedEvent(MIDI_EVENT_PROGRAM, channel, program, 0);
+}
+
+void OnPitchChange(byte channel, int pitch)
+{
+  QueueLatestEvent(MIDI_EVENT_PITCH, channel, 0, pitch);
+}
+
+void OnControlChange(byte channel, byte control, byte value)
+{
+  switch (control) 
+  {
+    case 0x40: //Sustain has to stay in order with the notes
+    QueueOrderedEvent(MIDI_EVENT_SUSTAIN, channel, control, value);
+    break;
+    case 99: //NRPN to control synth manually
+    nprmInput.parameter = value << 7;
+    break;
+    case 98:
+    nprmInput.parameter += value;
+    break;
+    case 6:
+    nprmInput.value = value << 7;
+    break;
+    case 38:
+    nprmInput.value = nprmInput.value + value;
+    QueueLatestEvent(MIDI_EVENT_NRPN, channel, nprmInput.parameter, nprmInput.value);
+    break;
+    default:
+    QueueLatestEvent(MIDI_EVENT_CONTROL, channel, control, value);
+    break;
   }
 }
 
-void SendPatchSysex(uint8_t slot)
+void DispatchMidiEvent(const MidiEvent &e)
 {
-  return; //This function seems to cause too many issues
+  switch (e.type) 
+  {
+    case MIDI_EVENT_NOTE_ON:
+    noteLatency.Dispatched(e.arrival);
+    KeyOn(e.channel, e.param, e.value);
+    break;
+    case MIDI_EVENT_NOTE_OFF:
+    KeyOff(e.channel, e.param, e.value);
+    break;
+    case MIDI_EVENT_PROGRAM:
+    ProgramChange(e.channel, e.param);
+    break;
+    case MIDI_EVENT_SUSTAIN:
+    case MIDI_EVENT_CONTROL:
+    ControlChange(e.channel, e.param, e.value);
+    break;
+    case MIDI_EVENT_PITCH:
+    PitchChange(e.channel, e.value);
+    break;
+    case MIDI_EVENT_NRPN:
+    nprm.parameter = e.param;
+    nprm.value = e.value;
+    //Serial.print("NPRM --- "); Serial.print("PARAM: "); Serial.print(nprm.parameter); Serial.print("   "); Serial.print("VALUE: "); Serial.println(nprm.value);
+    HandleNPRM(e.channel);
+    break;
+  }
+}
 
+void ProcessMidiEvents()
+{
+  MidiEvent e;
+  while(midiEvents.Pop(e))
+    DispatchMidiEvent(e);
+}
 
+//Patch dump source. Favorites come straight from EEPROM, a favorite still being written is taken from RAM
+bool GetDumpVoice(uint8_t item, Voice &v)
+{
+  if(item == DUMP_ITEM_CURRENT)
+  {
+    DecompileVoice(ym2612.GetSlotImage(0), v); //A favorite or an editor voice may have replaced the SD card voice
+    return true;
+  }
+  //Favorites are stored at their button number, 0 is never written
+  const FavoriteVoice *pending = PendingFavorite(item);
+  if(pending)
+  {
+    v = pending->v;
+    return true;
+  }
+  FavoriteVoice fv;
+  EEPROM.get(sizeof(FavoriteVoice)*item, fv);
+  if(fv.index != item)
+    return false;
+  v = fv.v;
+  return true;
+}
 
-  
-  uint8_t data[60];
-  uint8_t j = 3;
-  data[0] = 0xF0;
-  data[1] = MIDI_MFG_ID;
-  data[2] = slot+0x10; //replace device ID with slot indicator. Add a "1" to indicate direction
-  for(uint8_t i=0; i<5; i++) { data[j] = voices[slot].LFO[i]; j++; }
-  for(uint8_t i=0; i<7; i++) { data[j] = voices[slot].CH[i]; j++; }
-  for(uint8_t i=0; i<11; i++) { data[j] = voices[slot].M1[i]; j++; }
-  for(uint8_t i=0; i<11; i++) { data[j] = voices[slot].C1[i]; j++; }
-  for(uint8_t i=0; i<11; i++) { data[j] = voices[slot].M2[i]; j++; }
-  for(uint8_t i=0; i<11; i++) { data[j] = voices[slot].C2[i]; j++; }
-  data[59] = 0xF7; //Ending byte
-  usbMIDI.sendSysEx(60, data, true);
+//NRPN voice parameters. Operator entries are indexed by parameter%10 and offset by the operator,
+//channel entries start at NPRM_CHANNEL_FIELDS for parameters 52-55
+#define NPRM_SWITCH 0x01 //On/off parameter, anything above 63 is on
+#define NPRM_CHANNEL_FIELDS 10
+typedef struct
+{
+  uint8_t field; //VoiceImage byte offset (IMG_* for operator entries)
+  uint8_t addr;  //Register for operator 0, channel 0
+  uint8_t mask;
+  uint8_t shift;
+  uint8_t flags;
+} NprmField;
+
+static constexpr NprmField nprmFields[] PROGMEM = 
+{
+  {IMG_DT1MUL, 0x30, 0x07, 4, 0},           //x0 Detune
+  {IMG_DT1MUL, 0x30, 0x0F, 0, 0},           //x1 Multiple
+  {IMG_TL, 0x40, 0x7F, 0, 0},               //x2 Total level
+  {IMG_RSAR, 0x50, 0x1F, 0, 0},             //x3 Attack rate
+  {IMG_AMD1R, 0x60, 0x1F, 0, 0},            //x4 Decay rate 1
+  {IMG_D2R, 0x70, 0x1F, 0, 0},              //x5 Decay rate 2
+  {IMG_D1LRR, 0x80, 0x0F, 4, 0},            //x6 Decay level 1
+  {IMG_D1LRR, 0x80, 0x0F, 0, 0},            //x7 Release rate
+  {IMG_RSAR, 0x50, 0x03, 6, 0},             //x8 Rate scaling
+  {IMG_AMD1R, 0x60, 0x01, 7, NPRM_SWITCH},  //x9 Amplitude modulation
+  {offsetof(VoiceImage, LRAMSFMS), 0xB4, 0x07, 0, 0}, //52 Frequency modulation sensitivity
+  {offsetof(VoiceImage, LRAMSFMS), 0xB4, 0x03, 4, 0}, //53 Amplitude modulation sensitivity
+  {offsetof(VoiceImage, FBALGO), 0xB0, 0x07, 0, 0},   //54 Algorithm
+  {offsetof(VoiceImage, FBALGO), 0xB0, 0x07, 3, 0},   //55 Feedback
+};
+
+//Resolve a voice parameter to its VoiceImage byte and channel 0 register. False for anything that is not a voice field
+bool LookupNprmField(uint16_t param, uint8_t &value, NprmField &f)
+{
+  if(param >= 10 && param <= 49)
+  {
+    uint8_t op = (param/10)-1;
+    memcpy_P(&f, &nprmFields[param%10], sizeof(NprmField));
+    f.field += offsetof(VoiceImage, OP) + op*IMG_OP_REGS;
+    f.addr += op*4;
+  }
+  else if(param >= 52 && param <= 55)
+    memcpy_P(&f, &nprmFields[NPRM_CHANNEL_FIELDS + param-52], sizeof(NprmField));
+  else
+    return false;
+  if(f.flags & NPRM_SWITCH)
+    value = value > 63;
+  return true;
 }
 
+//OPM block: F0 MFG 0n <56 OPM bytes> F7
+//Parameter list: F0 MFG 2n <param> <value> ... F7, using the NRPN parameter numbers
+//MFG is MIDI_MFG_ID or MIDI_MFG_ID_7BIT. Over DIN only the 7-bit ID gets through
 void SystemExclusive(byte *data, uint16_t length)
 {
   //Serial.print("SYSEX: "); Serial.print(" DATA: "); Serial.print(data[0]); Serial.print(" LENGTH: "); Serial.println(length);
+  if(length < 4 || data[0] != 0xF0 || (data[1] != MIDI_MFG_ID && data[1] != MIDI_MFG_ID_7BIT))
+    return;
+  uint8_t command = data[2] & 0xF0;
+  uint8_t slot = data[2] & 0x0F;
+  if(command == SYSEX_DUMP_REQUEST)
+  {
+    patchDump.Request(slot);
+    return;
+  }
+  if(command == SYSEX_DUMP_ACK)
+  {
+    if(length >= 5)
+      patchDump.Ack(slot, data[3]);
+    return;
+  }
   VSTMode();
-  if(data[0] == 0xF0 && data[1] == MIDI_MFG_ID) //Patch data recieved (OPM Format), use device ID to mark slot to set. 0 = all, 1 = slot 1, 2 = slot 2, etc.
+  if(slot > MAX_CHANNELS_YM)
+    return;
+  if(command == SYSEX_OPM_BLOCK)
   {
+    if(length < 60)
+      return;
     int i = 3;
-    for(; i<8; i++) { voices[0].LFO[i-3] = data[i]; }
-    for(; i<15; i++) { voices[0].CH[i-8] = data[i]; }
-    for(; i<26; i++) { voices[0].M1[i-15] = data[i]; }
-    for(; i<37; i++) { voices[0].C1[i-26] = data[i]; }
-    for(; i<48; i++) { voices[0].M2[i-37] = data[i]; }
-    for(; i<59; i++) { voices[0].C2[i-48] = data[i]; }
+    Voice v;
+    for(; i<8; i++) { v.LFO[i-3] = data[i]; }
+    for(; i<15; i++) { v.CH[i-8] = data[i]; }
+    for(; i<26; i++) { v.M1[i-15] = data[i]; }
+    for(; i<37; i++) { v.C1[i-26] = data[i]; }
+    for(; i<48; i++) { v.M2[i-37] = data[i]; }
+    for(; i<59; i++) { v.C2[i-48] = data[i]; }
+    if(slot != 0)
+    {
+      VoiceImage img;
+      CompileVoice(v, img);
+      ym2612.SetVoiceManual(slot-1, img);
+      return;
+    }
+    CompileVoice(v, voices[0]);
 
     ym2612.SetVoice(voices[0]);
     currentProgram = 0;
     LCDRedraw();
   }
+  else if(command == SYSEX_PARAM_LIST)
+  {
+    //Edit a copy and write it once so the chip never plays a half-applied patch.
+    //Only registers that changed reach the bus, the rest are elided against the shadow
+    VoiceImage img = slot == 0 ? voices[0] : ym2612.GetSlotImage(slot-1);
+    uint8_t applied = 0;
+    for(uint16_t i = 3; i+1 < length && data[i+1] != 0xF7; i += 2)
+    {
+      NprmField f;
+      uint8_t value = data[i+1];
+      if(!LookupNprmField(data[i], value, f))
+        continue;
+      SetImageField(((unsigned char *)&img)[f.field], f.mask, f.shift, value);
+      applied++;
+    }
+    if(applied == 0)
+      return;
+    if(slot == 0)
+    {
+      voices[0] = img;
+      ym2612.SetVoice(voices[0], true);
+    }
+    else
+      ym2612.SetVoiceManual(slot-1, img);
+  }
+}
+
+//The MIDI library hands over the whole message, F0 and F7 included, like usbMIDI does
+void DinSystemExclusive(byte *data, unsigned length)
+{
+  SystemExclusive(data, length);
 }
 
 uint8_t lastProgram = 0;
@@ -838,7 +1152,7 @@ void ProgramChange(byte channel, byte program)
   program %= maxValidVoices;
   currentProgram = program;
   LCDRedraw(lcdSelectionIndex);
-  ym2612.SetVoice(voices[currentProgram]);
+  ym2612.SetVoice(voices[currentProgram], true);
   Serial.print("Current Voice Number: "); Serial.print(currentProgram); Serial.print("/"); Serial.println(maxValidVoices-1);
   DumpVoiceData(voices[currentProgram]);
   lastProgram = program;
@@ -905,6 +1219,72 @@ void HandleSerialIn()
         return;
       }
       break;
+      case 's': //Dump YM2612 issued/elided register write counts
+      {
+        ym2612.DumpWriteStats();
+        return;
+      }
+      break;
+      case 'c': //Measure the YM2612 busy period and print busy flag statistics
+      {
+        ym2612.CalibrateBusy();
+        return;
+      }
+      break;
+      case 'C': //Toggle polling the YM2612 busy flag before each write
+      {
+        ym2612.SetBusyPolling(!ym2612.GetBusyPolling());
+        return;
+      }
+      break;
+      case 'w': //Benchmark YM2612 bus writes per second
+      {
+        ym2612.BenchmarkBus();
+        return;
+      }
+      break;
+      case 'm': //Dump DIN MIDI receive buffer statistics
+      {
+        midiUart.DumpStats();
+        return;
+      }
+      break;
+      case 'q': //Dump and reset MIDI event queue depth and coalescing statistics
+      {
+        midiEvents.DumpStats();
+        return;
+      }
+      break;
+      case 'k': //Dump and reset scheduler task run times
+      {
+        scheduler.DumpStats();
+        return;
+      }
+      break;
+      case 'f': //Dump and reset LCD flush counts and worst-case flush time
+      {
+        lcd.DumpStats();
+        return;
+      }
+      break;
+      case 'u': //Dump and reset PORTF bus ownership statistics
+      {
+        dataBus.DumpStats();
+        return;
+      }
+      break;
+      case 'v': //Dump and reset VST patch dump statistics
+      {
+        patchDump.DumpStats();
+        return;
+      }
+      break;
+      case 't': //Dump and reset note-on latency histograms
+      {
+        noteLatency.DumpAndReset();
+        return;
+      }
+      break;
       default:
         continue;
     }
@@ -960,9 +1340,7 @@ void ScrollFileNameLCD()
   {
     prevMilli = curMilli;
     //Clear top line
-    lcd.setCursor(0, 0);
-    lcd.println("");
-    lcd.setCursor(0, 0);
+    lcd.ClearRow(0);
 
     //Draw filename substring    
     lcd.setCursor(1, 0);
@@ -1003,107 +1381,131 @@ void UpdateLEDs()
   digitalWriteFast(leds[currentFavorite], HIGH);
 }
 
-void HandleFavoriteButtons(byte portValue)
+//Favorite buttons are polled from loop() and never wait, so MIDI keeps flowing while one is held
+void HandleFavoriteButtons()
 {
-  uint8_t prevFavorite = currentFavorite;
-  switch(portValue)
+  byte pressed = ~PINA;
+  uint32_t now = millis();
+  switch(favoriteState)
   {
-    case 1: //LFO
-    ym2612.ToggleLFO();
-    break;
-    case 2: //Fav 1
-    currentFavorite != 1 ? currentFavorite = 1 : currentFavorite = 0xFF;
-    break;
-    case 4: //Fav 2
-    currentFavorite != 2 ? currentFavorite = 2 : currentFavorite = 0xFF;
-    break;
-    case 8: //Fav 3
-    currentFavorite != 3 ? currentFavorite = 3 : currentFavorite = 0xFF;
-    break;
-    case 16: //Fav 4
-    currentFavorite != 4 ? currentFavorite = 4 : currentFavorite = 0xFF;
-    break;
-    case 32: //Fav 5
-    currentFavorite != 5 ? currentFavorite = 5 : currentFavorite = 0xFF;
-    break;
-    case 64: //Fav 6
-    currentFavorite != 6 ? currentFavorite = 6 : currentFavorite = 0xFF;
-    break;
-    case 128: //Fav 7
-    currentFavorite != 7 ? currentFavorite = 7 : currentFavorite = 0xFF;
-    break;
-    default:
+    case FAV_IDLE:
+    if(!pressed)
+      break;
+    favoriteButtons = pressed;
+    favoritePrevious = currentFavorite;
+    favoriteChangedAt = now;
+    switch(pressed)
+    {
+      case 1: //LFO
+      ym2612.ToggleLFO();
+      break;
+      case 2: //Fav 1
+      currentFavorite != 1 ? currentFavorite = 1 : currentFavorite = 0xFF;
+      break;
+      case 4: //Fav 2
+      currentFavorite != 2 ? currentFavorite = 2 : currentFavorite = 0xFF;
+      break;
+      case 8: //Fav 3
+      currentFavorite != 3 ? currentFavorite = 3 : currentFavorite = 0xFF;
+      break;
+      case 16: //Fav 4
+      currentFavorite != 4 ? currentFavorite = 4 : currentFavorite = 0xFF;
+      break;
+      case 32: //Fav 5
+      currentFavorite != 5 ? currentFavorite = 5 : currentFavorite = 0xFF;
+      break;
+      case 64: //Fav 6
+      currentFavorite != 6 ? currentFavorite = 6 : currentFavorite = 0xFF;
+      break;
+      case 128: //Fav 7
+      currentFavorite != 7 ? currentFavorite = 7 : currentFavorite = 0xFF;
+      break;
+      default:
+      break;
+    }
+    favoriteState = FAV_HELD;
     break;
-  }
 
-  uint32_t i = 0;
-  bool favoriteProgrammed = false;
-  while(PINA == portValue || PINA != 0xFF)
-  {
-    if(portValue != 1)
+    case FAV_HELD:
+    if(!pressed) //Short press, switch voices
     {
-      delay(1);
-      if(i >= 2000 && !favoriteProgrammed)
+      if(favoriteButtons != 1)
+      {
+        if(currentFavorite != 0xFF)
+          ym2612.SetVoice(GetFavoriteFromEEPROM(currentFavorite), true);
+        else
+        {
+          ym2612.SetVoice(voices[currentProgram], true);
+          LCDRedraw(lcdSelectionIndex);
+        }
+      }
+      UpdateLEDs();
+      favoriteState = FAV_DEBOUNCE;
+      favoriteChangedAt = now;
+    }
+    else if(favoriteButtons != 1 && now - favoriteChangedAt >= FAVORITE_HOLD_MS) //Held, save the current voice
+    {
+      if(isFileValid)
       {
-        if(!isFileValid)
-          return;
         if(currentFavorite == 0xFF)
-          currentFavorite = prevFavorite;
+          currentFavorite = favoritePrevious;
         ProgramNewFavorite();
-        favoriteProgrammed = true;
       }
-      i++;
+      favoriteState = FAV_WAIT_RELEASE;
     }
-  } 
-  if(!favoriteProgrammed)
-  {
-    if(currentFavorite != 0xFF)
-      ym2612.SetVoice(GetFavoriteFromEEPROM(currentFavorite));
-    else
+    break;
+
+    case FAV_WAIT_RELEASE:
+    if(!pressed)
     {
-      ym2612.SetVoice(voices[currentProgram]);
-      LCDRedraw(lcdSelectionIndex);
-      currentFavorite = 0xFF;
+      UpdateLEDs();
+      favoriteState = FAV_DEBOUNCE;
+      favoriteChangedAt = now;
     }
+    break;
+
+    case FAV_DEBOUNCE:
+    if(pressed)
+      favoriteChangedAt = now;
+    else if(now - favoriteChangedAt >= FAVORITE_DEBOUNCE_MS)
+      favoriteState = FAV_IDLE;
+    break;
   }
-  UpdateLEDs();
-  delay(50); //Debounce
+  UpdateFavoriteWrite();
+  UpdateFavoriteBlink(now);
 }
-
 void BlinkLED(byte led)
 {
   if(led >= 8)
     return;
-  for(int i = 0; i < 4; i++)
-  {
-    digitalWriteFast(leds[led], HIGH);
-    delay(100);
-    digitalWriteFast(leds[led], LOW);
-    delay(100);
-  }
+  favoriteBlinkLED = led;
+  favoriteBlinkStart = millis();
 }
-
-void ClearLCDLine(byte line)
+//4 blinks, 100mS on, 100mS off, then back on
+void UpdateFavoriteBlink(uint32_t now)
 {
-  if(line >= LCD_ROWS-1)
+  if(favoriteBlinkLED >= 8)
+    return;
+  uint32_t elapsed = now - favoriteBlinkStart;
+  if(elapsed >= 800)
+  {
+    digitalWriteFast(leds[favoriteBlinkLED], HIGH);
+    favoriteBlinkLED = 0xFF;
     return;
-  lcd.setCursor(0, line);
-  for(int i=0; i<LCD_COLS; i++)
-  {}
-    lcd.write(' ');
-  lcd.setCursor(0, line);
+  }
+  digitalWriteFast(leds[favoriteBlinkLED], (elapsed / 100) & 1 ? LOW : HIGH);
 }
-
 void ProgramNewFavorite()
 {
   if(currentFavorite == 0xFF)
     return;
   Serial.print("NEW FAVORITE: "); Serial.println(currentFavorite);
-  PutFavoriteIntoEEPROM(voices[currentProgram], currentFavorite);
-  GetFavoriteFromEEPROM(currentFavorite);
-  LCDRedraw(lcdSelectionIndex);
-  BlinkLED(currentFavorite);
-  digitalWriteFast(leds[currentFavorite], HIGH);
+  if(!PutFavoriteIntoEEPROM(voices[currentProgram], currentFavorite))
+  {
+    Serial.println("Favorite not saved, two are still being written");
+    return;
+  }
+  BlinkLED(currentFavorite); //The LCD is redrawn once the EEPROM write has finished
 }
 
 void VSTMode()
@@ -1113,11 +1515,12 @@ void VSTMode()
     currentProgram = 0;
     redrawLCDOnNextLoop = true;
   }
-  if(strcmp(fileName, "VST") != 0)
+  if(!vstModeActive)
   {
     memset(fileName, 0x00, MAX_FILE_NAME_SIZE);
     strcpy(fileName, "VST");
     maxValidVoices = 1;
+    vstModeActive = true;
     Serial.println(fileName);
     redrawLCDOnNextLoop = true;
   }
@@ -1126,164 +1529,116 @@ void VSTMode()
 void HandleNPRM(uint8_t channel)
 {
   VSTMode();
-  uint8_t op = ((nprm.parameter/10)%10)-1;
-  for(int i = 0; i < MAX_CHANNELS_YM; i++)
+  uint16_t param = nprm.parameter;
+  uint8_t value = nprm.value;
+  NprmField f;
+  if(LookupNprmField(param, value, f))
+  {
+    SetImageField(((unsigned char *)&voices[0])[f.field], f.mask, f.shift, value);
+    ym2612.SetVoiceField(f.field, f.addr, f.mask, f.shift, value);
+    return;
+  }
+
+  switch(param)
   {
-    switch(nprm.parameter)
+    case 50:
+      ym2612.SetLFOEnabled(value > 63);
+      break;
+    case 51:
+      ym2612.SetLFOFreq(value);
+      break;
+    case 57:
+      ym2612.Reset();
+      break;
+    case 63:
+      patchDump.Request(DUMP_ITEM_CURRENT);
+      break;
+    case 71:
+    case 72:
+    case 73:
+    case 74:
+    case 75:
+    case 76:
+    case 77:
+    {
+      uint8_t vstFav = param % 70;
+      if(vstFav != currentFavorite)
       {
-        case 10:
-        case 20:
-        case 30:
-        case 40:
-          ym2612.SetDetune(i, op, nprm.value);
-          switch(op){ case 0: voices[0].M1[8] = nprm.value; break; case 1: voices[0].C1[8] = nprm.value;  break; case 2: voices[0].M2[8] = nprm.value;  break; case 3: voices[0].C2[8] = nprm.value;  break; }
-          break;
-        case 11:
-        case 21:
-        case 31:
-        case 41:
-          ym2612.SetMult(i, op, nprm.value);
-          switch(op){ case 0: voices[0].M1[7] = nprm.value; break; case 1: voices[0].C1[7] = nprm.value;  break; case 2: voices[0].M2[7] = nprm.value;  break; case 3: voices[0].C2[7] = nprm.value;  break; }
-          break;
-        case 12:
-        case 22:
-        case 32:
-        case 42:
-          ym2612.SetTL(i, op, nprm.value);
-          switch(op){ case 0: voices[0].M1[5] = nprm.value; break; case 1: voices[0].C1[5] = nprm.value;  break; case 2: voices[0].M2[5] = nprm.value;  break; case 3: voices[0].C2[5] = nprm.value;  break; }
-          break;
-        case 13:
-        case 23:
-        case 33:
-        case 43:
-          ym2612.SetAR(i, op, nprm.value);
-          switch(op){ case 0: voices[0].M1[0] = nprm.value; break; case 1: voices[0].C1[0] = nprm.value;  break; case 2: voices[0].M2[0] = nprm.value;  break; case 3: voices[0].C2[0] = nprm.value;  break; }
-          break;
-        case 14:
-        case 24:
-        case 34:
-        case 44:
-          ym2612.SetD1R(i, op, nprm.value);
-          switch(op){ case 0: voices[0].M1[1] = nprm.value; break; case 1: voices[0].C1[1] = nprm.value;  break; case 2: voices[0].M2[1] = nprm.value;  break; case 3: voices[0].C2[1] = nprm.value;  break; }
-          break;
-        case 15:
-        case 25:
-        case 35:
-        case 45:
-          ym2612.SetD2R(i, op, nprm.value);
-          switch(op){ case 0: voices[0].M1[2] = nprm.value; break; case 1: voices[0].C1[2] = nprm.value;  break; case 2: voices[0].M2[2] = nprm.value;  break; case 3: voices[0].C2[2] = nprm.value;  break; }
-          break;
-        case 16:
-        case 26:
-        case 36:
-        case 46:
-          ym2612.SetD1L(i, op, nprm.value);
-          switch(op){ case 0: voices[0].M1[4] = nprm.value; break; case 1: voices[0].C1[4] = nprm.value;  break; case 2: voices[0].M2[4] = nprm.value;  break; case 3: voices[0].C2[4] = nprm.value;  break; }
-          break;
-        case 17:
-        case 27:
-        case 37:
-        case 47:
-          ym2612.SetRR(i, op, nprm.value);
-          switch(op){ case 0: voices[0].M1[3] = nprm.value; break; case 1: voices[0].C1[3] = nprm.value;  break; case 2: voices[0].M2[3] = nprm.value;  break; case 3: voices[0].C2[3] = nprm.value;  break; }
-          break;
-        case 18:
-        case 28:
-        case 38:
-        case 48:
-          ym2612.SetRateScaling(i, op, nprm.value);
-          switch(op){ case 0: voices[0].M1[6] = nprm.value; break; case 1: voices[0].C1[6] = nprm.value;  break; case 2: voices[0].M2[6] = nprm.value;  break; case 3: voices[0].C2[6] = nprm.value;  break; }
-          break;  
-        case 19:
-        case 29:
-        case 39:
-        case 49:
-        {
-          bool setAM = nprm.value > 63;
-          ym2612.SetAmplitudeModulation(i, op, setAM);
-          switch(op){ case 0: voices[0].M1[10] = setAM; break; case 1: voices[0].C1[10] = setAM;  break; case 2: voices[0].M2[10] = setAM;  break; case 3: voices[0].C2[10] = setAM;  break; }
-          break;  
-        }
-        case 50:
-        {
-          bool lfoEn = nprm.value > 63;
-          for(uint8_t i = 0; i < MAX_CHANNELS_YM; i++)
-            voices[i].LFO[4] = lfoEn;
-          ym2612.SetLFOEnabled(lfoEn);
-          break;
-        }
-        case 51:
-          for(uint8_t i = 0; i < MAX_CHANNELS_YM; i++)
-            voices[i].LFO[0] = nprm.value;
-          ym2612.SetLFOFreq(nprm.value);
-          break;
-        case 52:
-          ym2612.SetFreqModSens(i, nprm.value);
-          voices[0].CH[4] = nprm.value;
-          break;
-        case 53:
-          ym2612.SetAMSens(i, nprm.value);
-          voices[0].CH[3] = nprm.value;
-          break;
-        case 54:
-          ym2612.SetAlgo(i, nprm.value);
-          voices[0].CH[2] = nprm.value;
-          break;
-        case 55:
-          ym2612.SetFMFeedback(i, nprm.value);
-          voices[0].CH[1] = nprm.value;
-          break;
-        case 57:
-          ym2612.Reset();
-          break;
-        case 63:
-          sendPatchToVST = nprm.value;
-        break;
-        case 71:
-        case 72:
-        case 73:
-        case 74:
-        case 75:
-        case 76:
-        case 77:
-        {
-          uint8_t vstFav = nprm.parameter % 70;
-          if(vstFav != currentFavorite)
-          {
-            currentFavorite = vstFav;
-            UpdateLEDs();
-            ProgramNewFavorite();
-          }
-        }
-        break;
-        default:
-          Serial.println("NPRM DEFAULT");
-        break;
+        currentFavorite = vstFav;
+        UpdateLEDs();
+        ProgramNewFavorite();
       }
+      break;
     }
+    default:
+      Serial.println("NPRM DEFAULT");
+      break;
   }
+}
 
 void loop() 
+{
+  scheduler.Run();
+}
+
+//Scheduler tasks, see setup() for priorities and budgets
+void TaskMidiInput()
 {
   while (usbMIDI.read()) {};
-  MIDI.read();
+  while (midiUart.available()) 
+    MIDI.read();
+}
+
+void TaskMidiApply()
+{
+  ProcessMidiEvents();
+  ym2612.UpdatePitchBend();
+  sn76489.UpdatePitchBend();
+}
+
+void TaskButtons()
+{
   HandleRotaryEncoder();
+  HandleFavoriteButtons();
+}
+
+//The LCD gives way as soon as MIDI is waiting or the YM2612 queue has writes for the bus
+//usbMIDI has no available() on the Teensy++2.0. Peek at the MIDI RX endpoint the way usbMIDI.read() does,
+//a bank that is still held (RXOUTI) may have another one queued behind it so it counts as pending too
+bool UsbMidiPending()
+{
+  uint8_t sreg = SREG;
+  cli();
+  UENUM = MIDI_RX_ENDPOINT;
+  bool pending = UEINTX & ((1 << RWAL) | (1 << RXOUTI));
+  SREG = sreg;
+  return pending;
+}
+
+bool LCDShouldYield()
+{
+  return midiUart.available() || UsbMidiPending() || ym2612.Pending() || scheduler.SliceExpired();
+}
+
+void TaskLCD()
+{
   if(redrawLCDOnNextLoop)
   {
     redrawLCDOnNextLoop = false;
     LCDRedraw(lcdSelectionIndex);
   }
   ScrollFileNameLCD();
-  
+  lcd.Flush(LCD_FLUSH_CHARS, LCDShouldYield);
+}
+
+void TaskVSTPatch()
+{
+  patchDump.Update();
+}
+
+void TaskSerial()
+{
   if(Serial.available() > 0)
     HandleSerialIn();
-  byte portARead = ~PINA;
-  if(portARead)
-    HandleFavoriteButtons(portARead);
-  if(sendPatchToVST != 0xFF)
-  {
-    SendPatchSysex(sendPatchToVST);
-    sendPatchToVST = 0xFF;
-  }
 }
  
\ No newline at end of file
@@ -0,0 +1,82 @@
+#ifndef NATIVE_ARDUINO_H_
+#define NATIVE_ARDUINO_H_
+//Just enough of the Teensy++2.0 core to build the sound chip drivers on the host for `pio test -e native`.
+//Port and timer registers are plain variables, millis()/micros() follow nativeMillis so tests can move time on.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+inline volatile uint8_t PORTA, PORTB, PORTC, PORTD, PORTE, PORTF;
+inline volatile uint8_t DDRA, DDRB, DDRC, DDRD, DDRE, DDRF;
+inline volatile uint8_t PINA, PINB, PINC, PIND, PINE, PINF;
+inline volatile uint8_t TCCR2A, TCCR2B, OCR2A, TIMSK2, SREG;
+
+#define WGM21 1
+#define CS21 1
+#define OCIE2A 1
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define HEX 16
+#define DEC 10
+#define PROGMEM
+#define ISR(vector) extern "C" void vector(void)
+#define cli()
+#define sei()
+#define bit(b) (1UL << (b))
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+
+inline uint32_t nativeMillis = 0;
+inline unsigned long millis() { return nativeMillis; }
+inline unsigned long micros() { return nativeMillis * 1000UL; }
+inline void delay(unsigned long) {}
+inline void delayMicroseconds(unsigned int) {}
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWriteFast(uint8_t, uint8_t) {}
+inline long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+template<class T> T min(T a, T b) { return a < b ? a : b; }
+template<class T> T max(T a, T b) { return a > b ? a : b; }
+
+class NativeSerial
+{
+public:
+  template<class T> size_t print(T) { return 0; }
+  template<class T> size_t print(T, int) { return 0; }
+  size_t println() { return 0; }
+  template<class T> size_t println(T) { return 0; }
+  template<class T> size_t println(T, int) { return 0; }
+};
+inline NativeSerial Serial;
+
+//Keeps the last SysEx sent so tests can look at it
+class NativeUsbMidi
+{
+public:
+  uint8_t sysex[64];
+  uint32_t sysexLength = 0;
+  uint32_t sysexSent = 0;
+  void sendSysEx(uint32_t length, const uint8_t *data, bool)
+  {
+    sysexLength = length < sizeof sysex ? length : sizeof sysex;
+    memcpy(sysex, data, sysexLength);
+    sysexSent++;
+  }
+};
+inline NativeUsbMidi usbMIDI;
+
+#endif
@@ -0,0 +1,2 @@
+#include <Arduino.h>
+#define memcpy_P(dest, src, n) memcpy((dest), (src), (n))
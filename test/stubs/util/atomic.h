@@ -0,0 +1,3 @@
+#include <Arduino.h>
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_BLOCK(type) for(int atomicOnce = 1; atomicOnce; atomicOnce = 0)
@@ -0,0 +1,200 @@
+#include <unity.h>
+#include "YM2612.h"
+
+//YM2612 channel allocator: free list, oldest-note stealing, sustain and the fixed VST channels
+
+YM2612 *ym;
+
+void setUp()
+{
+  YMsustainEnabled = false;
+  nativeMillis = 0;
+  ym = new YM2612();
+  ym->Reset();
+}
+
+void tearDown()
+{
+  delete ym;
+}
+
+uint8_t ChannelFor(uint8_t key)
+{
+  for(uint8_t i = 0; i<MAX_CHANNELS_YM; i++)
+  {
+    if(ym->channels[i].keyOn && ym->channels[i].keyNumber == key)
+      return i;
+  }
+  return YM_NO_CHANNEL;
+}
+
+uint8_t KeyedOn()
+{
+  uint8_t count = 0;
+  for(uint8_t i = 0; i<MAX_CHANNELS_YM; i++)
+    count += ym->channels[i].keyOn;
+  return count;
+}
+
+void test_allocates_distinct_channels()
+{
+  uint8_t used = 0;
+  for(uint8_t i = 0; i<MAX_CHANNELS_YM; i++)
+  {
+    ym->SetChannelOn(60+i, 127, false);
+    uint8_t ch = ChannelFor(60+i);
+    TEST_ASSERT_NOT_EQUAL(YM_NO_CHANNEL, ch);
+    TEST_ASSERT_FALSE(used & (1 << ch));
+    used |= 1 << ch;
+  }
+  TEST_ASSERT_EQUAL(MAX_CHANNELS_YM, KeyedOn());
+}
+
+void test_steals_oldest_note()
+{
+  for(uint8_t i = 0; i<MAX_CHANNELS_YM; i++)
+    ym->SetChannelOn(60+i, 127, false);
+  uint8_t oldest = ChannelFor(60);
+  uint8_t next = ChannelFor(61);
+  ym->SetChannelOn(72, 127, false);
+  TEST_ASSERT_EQUAL(oldest, ChannelFor(72));
+  TEST_ASSERT_EQUAL(YM_NO_CHANNEL, ChannelFor(60));
+  ym->SetChannelOff(60); //Stolen note's key off must not release the new one
+  TEST_ASSERT_EQUAL(oldest, ChannelFor(72));
+  ym->SetChannelOn(73, 127, false);
+  TEST_ASSERT_EQUAL(next, ChannelFor(73));
+}
+
+void test_release_reuses_longest_released()
+{
+  for(uint8_t i = 0; i<MAX_CHANNELS_YM; i++)
+    ym->SetChannelOn(60+i, 127, false);
+  uint8_t first = ChannelFor(62);
+  uint8_t second = ChannelFor(64);
+  ym->SetChannelOff(62);
+  ym->SetChannelOff(64);
+  TEST_ASSERT_EQUAL(MAX_CHANNELS_YM-2, KeyedOn());
+  ym->SetChannelOn(80, 127, false);
+  TEST_ASSERT_EQUAL(first, ChannelFor(80));
+  ym->SetChannelOn(81, 127, false);
+  TEST_ASSERT_EQUAL(second, ChannelFor(81));
+}
+
+void test_same_key_retriggers_its_channel()
+{
+  YMsustainEnabled = true;
+  ym->SetChannelOn(60, 127, false);
+  uint8_t ch = ChannelFor(60);
+  ym->SetChannelOn(60, 127, false);
+  TEST_ASSERT_EQUAL(ch, ChannelFor(60));
+  TEST_ASSERT_EQUAL(1, KeyedOn());
+}
+
+void test_sustain_holds_until_pedal_up()
+{
+  YMsustainEnabled = true;
+  ym->SetChannelOn(60, 127, false);
+  ym->SetChannelOn(64, 127, false);
+  ym->SetChannelOff(60);
+  ym->SetChannelOff(64);
+  TEST_ASSERT_EQUAL(2, KeyedOn());
+  YMsustainEnabled = false;
+  ym->ReleaseSustainedKeys();
+  TEST_ASSERT_EQUAL(0, KeyedOn());
+}
+
+void test_clamp_sustains_held_keys()
+{
+  ym->SetChannelOn(60, 127, false);
+  ym->ClampSustainedKeys();
+  ym->SetChannelOff(60);
+  TEST_ASSERT_EQUAL(1, KeyedOn());
+  ym->ReleaseSustainedKeys();
+  TEST_ASSERT_EQUAL(0, KeyedOn());
+}
+
+void test_fixed_channel_is_never_stolen()
+{
+  ym->SetFixedChannelOn(2, 50, 127);
+  for(uint8_t i = 0; i<3*MAX_CHANNELS_YM; i++)
+    ym->SetChannelOn(60+i, 127, false);
+  TEST_ASSERT_TRUE(ym->channels[2].keyOn);
+  TEST_ASSERT_EQUAL(50, ym->channels[2].keyNumber);
+  TEST_ASSERT_EQUAL(MAX_CHANNELS_YM, KeyedOn());
+
+  ym->SetFixedChannelOff(2, 50);
+  TEST_ASSERT_FALSE(ym->channels[2].keyOn);
+  ym->SetChannelOn(90, 127, false); //Released fixed channel is free again
+  TEST_ASSERT_EQUAL(2, ChannelFor(90));
+}
+
+void test_fixed_channel_taken_from_active_note()
+{
+  for(uint8_t i = 0; i<MAX_CHANNELS_YM; i++)
+    ym->SetChannelOn(60+i, 127, false);
+  uint8_t ch = ChannelFor(60);
+  ym->SetFixedChannelOn(ch, 40, 127);
+  TEST_ASSERT_EQUAL(ch, ChannelFor(40));
+  ym->SetChannelOff(60); //Its old note is gone
+  TEST_ASSERT_EQUAL(ch, ChannelFor(40));
+  ym->SetChannelOn(70, 127, false);
+  TEST_ASSERT_EQUAL(ch, ChannelFor(40));
+  TEST_ASSERT_NOT_EQUAL(YM_NO_CHANNEL, ChannelFor(70));
+}
+
+void test_no_channel_left_drops_the_note()
+{
+  for(uint8_t i = 0; i<MAX_CHANNELS_YM; i++)
+    ym->SetFixedChannelOn(i, 50+i, 127); //Free and active lists both empty
+  ym->SetChannelOn(40, 127, false);
+  TEST_ASSERT_EQUAL(YM_NO_CHANNEL, ChannelFor(40));
+  ym->SetChannelOff(40);
+  for(uint8_t i = 0; i<MAX_CHANNELS_YM; i++)
+  {
+    TEST_ASSERT_TRUE(ym->channels[i].keyOn);
+    TEST_ASSERT_EQUAL(50+i, ym->channels[i].keyNumber);
+  }
+}
+
+void test_mpe_voices_hold_every_channel()
+{
+  for(uint8_t i = 0; i<MAX_CHANNELS_YM; i++)
+    ym->SetFixedChannelOn(i, 60+i, 127); //MIDI channels 11-16
+  ym->SetChannelOn(40, 127, false); //Channel 1 has nowhere to go
+  TEST_ASSERT_EQUAL(MAX_CHANNELS_YM, KeyedOn());
+  TEST_ASSERT_EQUAL(YM_NO_CHANNEL, ChannelFor(40));
+
+  ym->SetFixedChannelOff(3, 63);
+  ym->SetChannelOn(40, 127, false);
+  TEST_ASSERT_EQUAL(3, ChannelFor(40));
+  ym->SetFixedChannelOn(3, 70, 127); //The MPE voice takes its channel back
+  TEST_ASSERT_EQUAL(YM_NO_CHANNEL, ChannelFor(40));
+  TEST_ASSERT_EQUAL(70, ym->channels[3].keyNumber);
+  ym->SetChannelOn(41, 127, false);
+  TEST_ASSERT_EQUAL(YM_NO_CHANNEL, ChannelFor(41));
+}
+
+void test_top_keys_fold_down_an_octave()
+{
+  ym->SetChannelOn(127+SEMITONE_ADJ_YM, 127, false);
+  TEST_ASSERT_NOT_EQUAL(YM_NO_CHANNEL, ChannelFor(127+SEMITONE_ADJ_YM-12));
+  ym->SetChannelOff(127+SEMITONE_ADJ_YM);
+  TEST_ASSERT_EQUAL(0, KeyedOn());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_allocates_distinct_channels);
+  RUN_TEST(test_steals_oldest_note);
+  RUN_TEST(test_release_reuses_longest_released);
+  RUN_TEST(test_same_key_retriggers_its_channel);
+  RUN_TEST(test_sustain_holds_until_pedal_up);
+  RUN_TEST(test_clamp_sustains_held_keys);
+  RUN_TEST(test_fixed_channel_is_never_stolen);
+  RUN_TEST(test_fixed_channel_taken_from_active_note);
+  RUN_TEST(test_no_channel_left_drops_the_note);
+  RUN_TEST(test_mpe_voices_hold_every_channel);
+  RUN_TEST(test_top_keys_fold_down_an_octave);
+  return UNITY_END();
+}
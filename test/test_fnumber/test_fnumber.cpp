@@ -0,0 +1,102 @@
+#include <unity.h>
+#include "YM2612.h"
+
+//The F-number table against the float note formula it replaced, and pitch bend interpolation
+
+YM2612 *ym;
+
+void setUp()
+{
+  ym = new YM2612();
+}
+
+void tearDown()
+{
+  delete ym;
+}
+
+//The old runtime NoteToFrequency(), in float like it was on the AVR
+uint16_t FormulaFNumber(int16_t note, int8_t octaveShift)
+{
+  static const float freq[12] = {277.2, 293.7, 311.1, 329.6, 349.2, 370.0, 392.0, 415.3, 440.0, 466.2, 493.9, 523.3};
+  static const float multiplier[YM_OCTAVES] = {0.03125f, 0.0625f, 0.125f, 0.25f, 0.5f, 1.0f, 2.0f, 4.0f, 8.0f, 16.0f, 32.0f};
+  int8_t octave = note/12 + octaveShift;
+  if(octave < 0)
+    octave = 0;
+  else if(octave >= YM_OCTAVES)
+    octave = YM_OCTAVES-1;
+  float f = freq[note%12];
+  return (uint16_t)((f + f*(float)TUNE) * multiplier[octave]);
+}
+
+long Map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+void test_table_matches_formula()
+{
+  for(int8_t shift = -MAX_OCTAVE_SHIFT; shift <= MAX_OCTAVE_SHIFT; shift++)
+  {
+    ym->SetOctaveShift(shift);
+    for(int16_t note = 0; note < YM_KEYS; note++)
+      TEST_ASSERT_EQUAL_MESSAGE(FormulaFNumber(note, shift), ym->NoteToFrequency(note), "F-number differs from the formula");
+  }
+}
+
+void test_bend_matches_map()
+{
+  //The old bend was map() between the float F-numbers either side of the key
+  for(int8_t shift = -MAX_OCTAVE_SHIFT; shift <= MAX_OCTAVE_SHIFT; shift++)
+  {
+    ym->SetOctaveShift(shift);
+    for(int16_t key = pitchBendYMRange; key < YM_KEYS-pitchBendYMRange; key++)
+    {
+      uint16_t from = FormulaFNumber(key-pitchBendYMRange, shift);
+      uint16_t to = FormulaFNumber(key+pitchBendYMRange, shift);
+      if(to < from)
+        continue; //Clamped octave, see test_bend_stays_between_notes
+      for(int32_t pitch = -8192; pitch < 8192; pitch += 7)
+        TEST_ASSERT_EQUAL_MESSAGE(Map(pitch, -8192, 8192, from, to), ym->BendFrequency(key, pitch), "Bend differs from map()");
+    }
+  }
+}
+
+void test_bend_stays_between_notes()
+{
+  //Past the top of the table the upper note wraps back into the clamped octave and is lower than the key
+  for(int8_t shift = -MAX_OCTAVE_SHIFT; shift <= MAX_OCTAVE_SHIFT; shift++)
+  {
+    ym->SetOctaveShift(shift);
+    for(int16_t key = pitchBendYMRange; key < YM_KEYS; key++)
+    {
+      uint16_t from = ym->NoteToFrequency(key-pitchBendYMRange);
+      uint16_t to = ym->NoteToFrequency(key+pitchBendYMRange);
+      uint16_t low = min(from, to);
+      uint16_t high = max(from, to);
+      for(int32_t pitch = -8192; pitch <= 8191; pitch += 64)
+      {
+        uint16_t f = ym->BendFrequency(key, pitch);
+        TEST_ASSERT_TRUE_MESSAGE(f >= low && f <= high, "Bend left the range between the notes");
+      }
+    }
+  }
+}
+
+void test_centre_bend_is_the_key()
+{
+  ym->SetOctaveShift(0);
+  TEST_ASSERT_EQUAL(ym->NoteToFrequency(60-pitchBendYMRange), ym->BendFrequency(60, -8192));
+  uint16_t centre = ym->BendFrequency(60, 0);
+  TEST_ASSERT_UINT_WITHIN(2, ym->NoteToFrequency(60), centre);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_table_matches_formula);
+  RUN_TEST(test_bend_matches_map);
+  RUN_TEST(test_bend_stays_between_notes);
+  RUN_TEST(test_centre_bend_is_the_key);
+  return UNITY_END();
+}
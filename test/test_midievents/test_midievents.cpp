@@ -0,0 +1,86 @@
+#include <unity.h>
+#include "MidiEvents.h"
+
+//MIDI event queue: ordered and coalesced events come back out in arrival order
+
+MidiEventQueue *queue;
+
+void setUp()
+{
+  queue = new MidiEventQueue();
+}
+
+void tearDown()
+{
+  delete queue;
+}
+
+MidiEvent Event(uint8_t type, uint8_t channel, uint16_t param, int16_t value)
+{
+  MidiEvent e = {type, channel, param, value, 0};
+  return e;
+}
+
+void ExpectPop(uint8_t type, uint8_t channel, int16_t value)
+{
+  MidiEvent e;
+  TEST_ASSERT_TRUE(queue->Pop(e));
+  TEST_ASSERT_EQUAL(type, e.type);
+  TEST_ASSERT_EQUAL(channel, e.channel);
+  TEST_ASSERT_EQUAL(value, e.value);
+}
+
+void test_bend_before_note_on_goes_first()
+{
+  queue->Coalesce(Event(MIDI_EVENT_PITCH, 11, 0, 1000)); //MPE: the note's bend, then the note
+  queue->Push(Event(MIDI_EVENT_NOTE_ON, 11, 60, 100));
+  ExpectPop(MIDI_EVENT_PITCH, 11, 1000);
+  ExpectPop(MIDI_EVENT_NOTE_ON, 11, 100);
+  MidiEvent e;
+  TEST_ASSERT_FALSE(queue->Pop(e));
+}
+
+void test_note_before_controller_keeps_its_place()
+{
+  queue->Push(Event(MIDI_EVENT_NOTE_ON, 1, 60, 100));
+  queue->Coalesce(Event(MIDI_EVENT_CONTROL, 1, 7, 50));
+  queue->Push(Event(MIDI_EVENT_NOTE_OFF, 1, 60, 0));
+  ExpectPop(MIDI_EVENT_NOTE_ON, 1, 100);
+  ExpectPop(MIDI_EVENT_CONTROL, 1, 50);
+  ExpectPop(MIDI_EVENT_NOTE_OFF, 1, 0);
+}
+
+void test_coalesced_value_keeps_first_position()
+{
+  queue->Coalesce(Event(MIDI_EVENT_PITCH, 12, 0, 100));
+  queue->Push(Event(MIDI_EVENT_NOTE_ON, 12, 64, 90));
+  queue->Coalesce(Event(MIDI_EVENT_PITCH, 12, 0, 200));
+  ExpectPop(MIDI_EVENT_PITCH, 12, 200); //Latest value, where the first bend arrived
+  ExpectPop(MIDI_EVENT_NOTE_ON, 12, 90);
+  MidiEvent e;
+  TEST_ASSERT_FALSE(queue->Pop(e));
+}
+
+void test_order_survives_sequence_wrap()
+{
+  MidiEvent e;
+  for(uint16_t i = 0; i<0xFFFF; i++) //Walk the counter up to the wrap
+  {
+    queue->Push(Event(MIDI_EVENT_NOTE_ON, 1, 60, 1));
+    queue->Pop(e);
+  }
+  queue->Push(Event(MIDI_EVENT_NOTE_ON, 1, 60, 100)); //Sequence 0xFFFF
+  queue->Coalesce(Event(MIDI_EVENT_PITCH, 1, 0, 300)); //Sequence 0
+  ExpectPop(MIDI_EVENT_NOTE_ON, 1, 100);
+  ExpectPop(MIDI_EVENT_PITCH, 1, 300);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_bend_before_note_on_goes_first);
+  RUN_TEST(test_note_before_controller_keeps_its_place);
+  RUN_TEST(test_coalesced_value_keeps_first_position);
+  RUN_TEST(test_order_survives_sequence_wrap);
+  return UNITY_END();
+}
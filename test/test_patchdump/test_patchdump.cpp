@@ -0,0 +1,161 @@
+#include <unity.h>
+#include "PatchDump.h"
+
+//Patch dump to the VST editor: 7-bit packing, checksum, one chunk in flight and giving up on a silent editor
+
+PatchDump *dump;
+
+bool Source(uint8_t item, Voice &v)
+{
+  uint8_t *raw = (uint8_t *)&v;
+  for(uint8_t i = 0; i<sizeof(Voice); i++)
+    raw[i] = item*0x40 + i*9; //Plenty of bytes with the high bit set
+  return item != 5; //Favorite 5 is empty
+}
+
+void setUp()
+{
+  nativeMillis = 1000;
+  usbMIDI.sysexSent = 0;
+  dump = new PatchDump();
+  dump->SetSource(Source);
+}
+
+void tearDown()
+{
+  delete dump;
+}
+
+//Checks the framing of the chunk just sent and unpacks its payload, returns the raw length
+uint8_t ReceiveChunk(uint8_t item, uint8_t chunk, uint8_t *out)
+{
+  uint8_t *d = usbMIDI.sysex;
+  uint8_t length = usbMIDI.sysexLength;
+  TEST_ASSERT_EQUAL_HEX8(0xF0, d[0]);
+  TEST_ASSERT_EQUAL_HEX8(MIDI_MFG_ID_7BIT, d[1]);
+  TEST_ASSERT_EQUAL_HEX8(SYSEX_PATCH_DUMP | item, d[2]);
+  TEST_ASSERT_EQUAL(chunk, d[3]);
+  TEST_ASSERT_EQUAL(DUMP_CHUNKS, d[4]);
+  TEST_ASSERT_EQUAL_HEX8(0xF7, d[length-1]);
+  for(uint8_t i = 1; i<length-1; i++)
+    TEST_ASSERT_TRUE(d[i] < 0x80);
+  TEST_ASSERT_EQUAL_HEX8(PatchDump::Checksum(&d[5], length-7), d[length-2]);
+  return PatchDump::Unpack(&d[5], length-7, out);
+}
+
+void test_pack_round_trip()
+{
+  uint8_t raw[DUMP_CHUNK_SIZE];
+  uint8_t packed[DUMP_CHUNK_SIZE + 4];
+  uint8_t unpacked[DUMP_CHUNK_SIZE];
+  for(uint8_t i = 0; i<sizeof raw; i++)
+    raw[i] = 0xFF - i*7;
+  TEST_ASSERT_EQUAL(32, PatchDump::Pack(raw, DUMP_CHUNK_SIZE, packed));
+  for(uint8_t i = 0; i<32; i++)
+    TEST_ASSERT_TRUE(packed[i] < 0x80);
+  TEST_ASSERT_EQUAL(DUMP_CHUNK_SIZE, PatchDump::Unpack(packed, 32, unpacked));
+  TEST_ASSERT_EQUAL_MEMORY(raw, unpacked, DUMP_CHUNK_SIZE);
+
+  //A short last group only carries the bytes it has
+  TEST_ASSERT_EQUAL(12, PatchDump::Pack(raw, 10, packed));
+  TEST_ASSERT_EQUAL(10, PatchDump::Unpack(packed, 12, unpacked));
+  TEST_ASSERT_EQUAL_MEMORY(raw, unpacked, 10);
+}
+
+void test_checksum_rejects_corruption()
+{
+  dump->Request(2);
+  dump->Update();
+  uint8_t *d = usbMIDI.sysex;
+  uint8_t payload = usbMIDI.sysexLength-7;
+  uint8_t sum = d[5+payload];
+  for(uint8_t i = 0; i<payload; i++)
+    sum += d[5+i];
+  TEST_ASSERT_EQUAL_HEX8(0, sum & 0x7F);
+  d[9] ^= 0x04;
+  TEST_ASSERT_NOT_EQUAL(d[5+payload], PatchDump::Checksum(&d[5], payload));
+}
+
+void test_chunks_wait_for_their_ack()
+{
+  Voice expected, received;
+  Source(2, expected);
+  dump->Request(2);
+  dump->Update();
+  TEST_ASSERT_EQUAL(1, usbMIDI.sysexSent);
+  uint8_t got = ReceiveChunk(2, 0, (uint8_t *)&received);
+  dump->Update(); //Nothing new until chunk 0 is acknowledged
+  TEST_ASSERT_EQUAL(1, usbMIDI.sysexSent);
+  dump->Ack(2, 1); //Wrong chunk
+  dump->Ack(3, 0); //Wrong item
+  dump->Update();
+  TEST_ASSERT_EQUAL(1, usbMIDI.sysexSent);
+  dump->Ack(2, 0);
+  dump->Update();
+  TEST_ASSERT_EQUAL(2, usbMIDI.sysexSent);
+  got += ReceiveChunk(2, 1, (uint8_t *)&received + got);
+  TEST_ASSERT_EQUAL(sizeof(Voice), got);
+  TEST_ASSERT_EQUAL_MEMORY(&expected, &received, sizeof(Voice));
+  dump->Ack(2, 0); //Late duplicate
+  dump->Ack(2, 1);
+  dump->Update();
+  TEST_ASSERT_EQUAL(2, usbMIDI.sysexSent);
+}
+
+void test_items_go_out_in_order_and_empty_ones_are_skipped()
+{
+  dump->Request(6);
+  dump->Request(5);
+  dump->Request(4);
+  uint8_t order[] = {4, 6};
+  uint8_t scratch[sizeof(Voice)];
+  for(uint8_t n = 0; n<2; n++)
+  {
+    for(uint8_t chunk = 0; chunk<DUMP_CHUNKS; chunk++)
+    {
+      dump->Update();
+      if(n == 1 && chunk == 0)
+        dump->Update(); //The first pass after item 4 finds favorite 5 empty
+      ReceiveChunk(order[n], chunk, scratch);
+      dump->Ack(order[n], chunk);
+    }
+  }
+  dump->Update();
+  TEST_ASSERT_EQUAL(2*DUMP_CHUNKS, usbMIDI.sysexSent);
+}
+
+void test_unacknowledged_chunk_is_resent_then_dropped()
+{
+  uint8_t scratch[sizeof(Voice)];
+  dump->Request(1);
+  dump->Request(3);
+  dump->Update();
+  for(uint8_t retry = 1; retry<=DUMP_RETRIES; retry++)
+  {
+    nativeMillis += DUMP_ACK_TIMEOUT_MS - 1;
+    dump->Update();
+    TEST_ASSERT_EQUAL(retry, usbMIDI.sysexSent);
+    nativeMillis += 1;
+    dump->Update();
+    TEST_ASSERT_EQUAL(retry+1, usbMIDI.sysexSent);
+    ReceiveChunk(1, 0, scratch);
+  }
+  nativeMillis += DUMP_ACK_TIMEOUT_MS;
+  dump->Update(); //Gives up on item 1
+  TEST_ASSERT_EQUAL(1+DUMP_RETRIES, usbMIDI.sysexSent);
+  dump->Ack(1, 0); //Too late
+  dump->Update(); //Moves on to item 3
+  TEST_ASSERT_EQUAL(2+DUMP_RETRIES, usbMIDI.sysexSent);
+  ReceiveChunk(3, 0, scratch);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_pack_round_trip);
+  RUN_TEST(test_checksum_rejects_corruption);
+  RUN_TEST(test_chunks_wait_for_their_ack);
+  RUN_TEST(test_items_go_out_in_order_and_empty_ones_are_skipped);
+  RUN_TEST(test_unacknowledged_chunk_is_resent_then_dropped);
+  return UNITY_END();
+}
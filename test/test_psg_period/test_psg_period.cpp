@@ -0,0 +1,96 @@
+#include <unity.h>
+#include <math.h>
+#include "SN76489.h"
+
+//SN76489 tone periods against clock/(32*f), octave folding of the low notes and bend interpolation
+
+SN76489 *sn;
+
+void setUp()
+{
+  sn = new SN76489();
+}
+
+void tearDown()
+{
+  delete sn;
+}
+
+//Exact period for a MIDI note, folded up an octave at a time like the chip code does
+double ExpectedPeriod(uint8_t note)
+{
+  double f = 440.0 * pow(2.0, (note - 69) / 12.0);
+  double period = 4000000.0 / (32.0 * f);
+  while(period >= 1024.0)
+    period /= 2.0;
+  return period;
+}
+
+void test_periods_match_clock()
+{
+  for(uint16_t note = 0; note < 128; note++)
+  {
+    double expected = ExpectedPeriod(note);
+    uint16_t period = sn->NoteToPeriod(note, 0);
+    TEST_ASSERT_TRUE_MESSAGE(fabs(period - expected) <= 1.0, "Period is off by more than one step");
+  }
+}
+
+void test_low_notes_fold()
+{
+  //Below ~A1 the period does not fit in 10 bits
+  for(uint16_t note = 0; note < 128; note++)
+  {
+    uint16_t period = sn->NoteToPeriod(note, 0);
+    TEST_ASSERT_TRUE(period > 0 && period <= 1023);
+  }
+  //A folded note is its octave up, so the same pitch class
+  for(uint8_t note = 0; note < 36; note++)
+  {
+    uint16_t low = sn->NoteToPeriod(note, 0);
+    uint16_t octaveUp = sn->NoteToPeriod(note + 12, 0);
+    TEST_ASSERT_TRUE_MESSAGE(low == octaveUp || (low >= 512 && octaveUp < 512 && abs(low - 2*octaveUp) <= 1), "Folded note is not an octave up");
+  }
+}
+
+void test_bend_reaches_neighbour_notes()
+{
+  //Bend is 4096 steps per semitone
+  for(uint8_t note = 1; note < 127; note++)
+  {
+    TEST_ASSERT_EQUAL(sn->NoteToPeriod(note + 1, 0), sn->NoteToPeriod(note, 4096));
+    TEST_ASSERT_EQUAL(sn->NoteToPeriod(note - 1, 0), sn->NoteToPeriod(note, -4096));
+  }
+}
+
+void test_bend_is_monotonic()
+{
+  //Above the folded range a higher bend never gives a longer period
+  for(uint8_t note = 49; note < 125; note++)
+  {
+    uint16_t last = sn->NoteToPeriod(note, -8192);
+    for(int bend = -8192; bend <= 8192; bend += 32)
+    {
+      uint16_t period = sn->NoteToPeriod(note, bend);
+      TEST_ASSERT_TRUE(period <= last);
+      last = period;
+    }
+  }
+}
+
+void test_bend_clamps_at_ends()
+{
+  TEST_ASSERT_EQUAL(sn->NoteToPeriod(0, 0), sn->NoteToPeriod(0, -8192));
+  TEST_ASSERT_EQUAL(sn->NoteToPeriod(127, 0), sn->NoteToPeriod(127, 8192));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_periods_match_clock);
+  RUN_TEST(test_low_notes_fold);
+  RUN_TEST(test_bend_reaches_neighbour_notes);
+  RUN_TEST(test_bend_is_monotonic);
+  RUN_TEST(test_bend_clamps_at_ends);
+  return UNITY_END();
+}
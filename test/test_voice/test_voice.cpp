@@ -0,0 +1,130 @@
+#include <unity.h>
+#include "YM2612.h"
+
+//Per-channel voices: velocity and the LFO work from the patch each channel was given, not the last global one
+
+YM2612 *ym;
+
+void setUp()
+{
+  ym = new YM2612();
+  ym->Reset();
+}
+
+void tearDown()
+{
+  delete ym;
+}
+
+VoiceImage MakeVoice(uint8_t tl, uint8_t d1r)
+{
+  VoiceImage v;
+  memset(&v, 0, sizeof v);
+  for(uint8_t op = 0; op<4; op++)
+  {
+    v.OP[op][IMG_TL] = tl;
+    v.OP[op][IMG_AMD1R] = d1r;
+  }
+  v.FBALGO = 0x07; //Every operator is a carrier
+  v.LRAMSFMS = 0xC0;
+  return v;
+}
+
+uint8_t ShadowTL(uint8_t channel, uint8_t op)
+{
+  return ym->GetShadowValue(0x40 + op*4 + channel%3, channel > 2);
+}
+
+uint8_t ShadowAMD1R(uint8_t channel, uint8_t op)
+{
+  return ym->GetShadowValue(0x60 + op*4 + channel%3, channel > 2);
+}
+
+void test_velocity_uses_the_channel_voice()
+{
+  ym->SetVoice(MakeVoice(0x10, 0x05));
+  ym->SetVoiceManual(4, MakeVoice(0x30, 0x05));
+  ym->SetChannelVelocity(4, 0);
+  TEST_ASSERT_TRUE(ShadowTL(4, 3) > 0x30);
+  ym->SetChannelVelocity(4, 127);
+  for(uint8_t op = 0; op<4; op++)
+    TEST_ASSERT_EQUAL_HEX8(0x30, ShadowTL(4, op));
+  ym->SetChannelVelocity(1, 127);
+  TEST_ASSERT_EQUAL_HEX8(0x10, ShadowTL(1, 0));
+}
+
+void test_slot_image_leaves_out_velocity()
+{
+  ym->SetVoiceManual(2, MakeVoice(0x20, 0x05));
+  ym->SetChannelVelocity(2, 0);
+  VoiceImage v = ym->GetSlotImage(2);
+  TEST_ASSERT_EQUAL_HEX8(0x20, v.OP[3][IMG_TL]);
+}
+
+void test_lfo_toggle_keeps_channel_voices()
+{
+  ym->SetVoice(MakeVoice(0x10, 0x05));
+  ym->SetVoiceManual(5, MakeVoice(0x10, 0x0A));
+  ym->ToggleLFO();
+  TEST_ASSERT_EQUAL_HEX8(0x8A, ShadowAMD1R(5, 0));
+  TEST_ASSERT_EQUAL_HEX8(0x85, ShadowAMD1R(0, 0));
+  ym->ToggleLFO();
+  TEST_ASSERT_EQUAL_HEX8(0x0A, ShadowAMD1R(5, 0));
+  TEST_ASSERT_EQUAL_HEX8(0x05, ShadowAMD1R(0, 0));
+}
+
+void test_field_edit_reaches_every_channel_voice()
+{
+  ym->SetVoice(MakeVoice(0x10, 0x05));
+  ym->SetVoiceManual(3, MakeVoice(0x30, 0x05));
+  ym->SetVoiceField(1, 0x40, 0x7F, 0, 0x18); //Operator 1 TL
+  TEST_ASSERT_EQUAL_HEX8(0x18, ym->GetSlotImage(3).OP[0][IMG_TL]);
+  TEST_ASSERT_EQUAL_HEX8(0x30, ym->GetSlotImage(3).OP[1][IMG_TL]);
+  TEST_ASSERT_EQUAL_HEX8(0x18, ShadowTL(0, 0));
+}
+
+uint8_t ShadowLRAMSFMS(uint8_t channel)
+{
+  return ym->GetShadowValue(0xB4 + channel%3, channel > 2);
+}
+
+void test_field_edits_keep_the_lfo_on()
+{
+  ym->SetVoice(MakeVoice(0x10, 0x05));
+  ym->ToggleLFO();
+  ym->SetVoiceField(IMG_AMD1R, 0x60, 0x01, 7, 0); //Operator 1 AM off
+  ym->SetVoiceField(offsetof(VoiceImage, LRAMSFMS), 0xB4, 0x03, 4, 1); //AMS
+  ym->SetVoiceField(offsetof(VoiceImage, LRAMSFMS), 0xB4, 0x07, 0, 2); //FMS
+  ym->SetAmplitudeModulation(2, 1, false);
+  for(uint8_t ch = 0; ch<MAX_CHANNELS_YM; ch++)
+  {
+    TEST_ASSERT_EQUAL_HEX8(0x85, ShadowAMD1R(ch, 0));
+    TEST_ASSERT_EQUAL_HEX8(0xF7, ShadowLRAMSFMS(ch));
+  }
+  TEST_ASSERT_EQUAL_HEX8(0x85, ShadowAMD1R(2, 1));
+  ym->ToggleLFO(); //The edits come back once the LFO lets go
+  TEST_ASSERT_EQUAL_HEX8(0x05, ShadowAMD1R(4, 0));
+  TEST_ASSERT_EQUAL_HEX8(0xD2, ShadowLRAMSFMS(4));
+}
+
+void test_am_sensitivity_setter_matches_the_field_table()
+{
+  ym->SetVoice(MakeVoice(0x10, 0x05));
+  ym->SetAMSens(1, 2);
+  TEST_ASSERT_EQUAL_HEX8(0xE0, ShadowLRAMSFMS(1));
+  TEST_ASSERT_EQUAL_HEX8(0xE0, ym->GetSlotImage(1).LRAMSFMS);
+  ym->SetVoiceField(offsetof(VoiceImage, LRAMSFMS), 0xB4, 0x03, 4, 2);
+  TEST_ASSERT_EQUAL_HEX8(ShadowLRAMSFMS(1), ShadowLRAMSFMS(0));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_velocity_uses_the_channel_voice);
+  RUN_TEST(test_slot_image_leaves_out_velocity);
+  RUN_TEST(test_lfo_toggle_keeps_channel_voices);
+  RUN_TEST(test_field_edit_reaches_every_channel_voice);
+  RUN_TEST(test_field_edits_keep_the_lfo_on);
+  RUN_TEST(test_am_sensitivity_setter_matches_the_field_table);
+  return UNITY_END();
+}
@@ -0,0 +1,112 @@
+#include <unity.h>
+#include "YM2612.h"
+
+//Register writes per program change: every consecutive pair of voices in bank.opm is replayed
+//through SetVoice() and the shadow registers, once as a full load and once as a delta
+
+const uint8_t BANK_VOICES_MAX = 16;
+VoiceImage bank[BANK_VOICES_MAX];
+uint8_t bankVoices = 0;
+YM2612 *ym;
+
+//Same layout ReadVoiceData() expects: "@:n name" followed by the LFO, CH, M1, C1, M2 and C2 lines
+void LoadBank()
+{
+  char path[256];
+  strncpy(path, __FILE__, sizeof path - 1);
+  path[sizeof path - 1] = 0;
+  char *dir = strrchr(path, '/');
+  strcpy(dir ? dir+1 : path, "bank.opm");
+  FILE *f = fopen(path, "r");
+  TEST_ASSERT_TRUE_MESSAGE(f != NULL, "bank.opm not found");
+  char line[128];
+  unsigned char raw[6][11];
+  bankVoices = 0;
+  while(fgets(line, sizeof line, f) && bankVoices < BANK_VOICES_MAX)
+  {
+    if(strncmp(line, "@:", 2) != 0)
+      continue;
+    if(strstr(line, "no Name"))
+      break;
+    for(int i = 0; i<6; i++)
+    {
+      TEST_ASSERT_TRUE(fgets(line, sizeof line, f) != NULL);
+      char *p = strchr(line, ':') + 1;
+      for(int j = 0; j<11; j++)
+        raw[i][j] = strtoul(p, &p, 10);
+    }
+    Voice v;
+    memcpy(v.LFO, raw[0], sizeof v.LFO);
+    memcpy(v.CH, raw[1], sizeof v.CH);
+    memcpy(v.M1, raw[2], sizeof v.M1);
+    memcpy(v.C1, raw[3], sizeof v.C1);
+    memcpy(v.M2, raw[4], sizeof v.M2);
+    memcpy(v.C2, raw[5], sizeof v.C2);
+    CompileVoice(v, bank[bankVoices++]);
+  }
+  fclose(f);
+}
+
+void setUp()
+{
+  LoadBank();
+  ym = new YM2612();
+  ym->Reset();
+}
+
+void tearDown()
+{
+  delete ym;
+}
+
+uint32_t TransitionWrites(uint8_t from, uint8_t to, bool delta)
+{
+  ym->SetVoice(bank[from]);
+  uint32_t before = ym->GetWritesIssued();
+  ym->SetVoice(bank[to], delta);
+  return ym->GetWritesIssued() - before;
+}
+
+void test_bank_loads()
+{
+  TEST_ASSERT_EQUAL(8, bankVoices);
+  TEST_ASSERT_EQUAL_HEX8(0x30, bank[0].FBALGO);
+  TEST_ASSERT_EQUAL_HEX8(0x30, bank[0].OP[0][IMG_DT1MUL]); //DT1 3, MUL 0
+  TEST_ASSERT_EQUAL_HEX8(0x12, bank[0].OP[0][IMG_AMD1R]);
+}
+
+void test_delta_transitions()
+{
+  uint32_t deltaTotal = 0, fullTotal = 0;
+  uint32_t fewest = 0xFFFFFFFF, most = 0;
+  for(uint8_t i = 1; i<bankVoices; i++)
+  {
+    uint32_t full = TransitionWrites(i-1, i, false);
+    uint32_t delta = TransitionWrites(i-1, i, true);
+    printf("%u -> %u: %lu writes, %lu full\n", i-1, i, (unsigned long)delta, (unsigned long)full);
+    TEST_ASSERT_TRUE(delta < full);
+    deltaTotal += delta;
+    fullTotal += full;
+    fewest = min(fewest, delta);
+    most = max(most, delta);
+  }
+  //Without the shadow every load is 6 channels x (4 operators x 7 + 2) = 180 register writes
+  printf("Delta min: %lu avg: %lu max: %lu, full avg: %lu, unelided: 180\n", (unsigned long)fewest,
+    (unsigned long)(deltaTotal/(bankVoices-1)), (unsigned long)most, (unsigned long)(fullTotal/(bankVoices-1)));
+}
+
+void test_neighbouring_patches_cost_only_their_differences()
+{
+  //Bass 1 -> Bass 2 differs in one modulator TL and one carrier RR, on each of the six channels
+  TEST_ASSERT_EQUAL(12, TransitionWrites(0, 1, true));
+  TEST_ASSERT_EQUAL(0, TransitionWrites(1, 1, true));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_bank_loads);
+  RUN_TEST(test_delta_transitions);
+  RUN_TEST(test_neighbouring_patches_cost_only_their_differences);
+  return UNITY_END();
+}